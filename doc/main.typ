@@ -39,11 +39,22 @@ Files: `image.h` | `image.c`
 
 Provides various methods for creating and manipulating an image buffer.
 
+=== Segment List
+Files: `segments.h` | `segments.c`
+
+A chain of byte buffers in the spirit of `struct iovec`. The compressor passes the header, block metadata and every block as separate segments, so the data is never concatenated before Huffman coding, and the output is written to the file with a single `writev`.
+
 == Run-length encoding (RLE) 
 Files: rle.h | rle.c
 
 The RLE technique used is based on the third option for encoding greyscale images from the presentation by doc. Vasicek @presentation. This method utilizes one bit to distinguish the byte type. The bits are grouped in sets of eight, with each group written into the output stream before the 8 bytes it belongs to. This incurs a 12.5% overhead in the output but allows each RLE segment to have up to 257 repeat values, as 0 or 1 repeat values are predetermined.
 
+The encoder finds the end of a run by comparing 32 bytes (AVX2) or 16 bytes (SSE2) against the repeated value at once, the first mismatch is located by a count of trailing zeros of the comparison mask. The kernel is selected at runtime, with a scalar fallback. A literal is recognized from the next byte alone, so data without runs pays no vector loads. The tokens are written straight into a byte buffer of `len + ceil(len / 8)` bytes, the worst case of literals only, and the flag byte of every 8 tokens is patched in place through a pointer.
+
+The decoder looks up how many bytes the 8 tokens of a flag byte take in a table of 256 entries. While the whole group and its longest possible output (8 runs of 257 bytes) fit, the group is decoded without any bounds check. Consecutive literals are copied as one 8-byte word and runs are filled by 16-byte stores, spilling over bytes that the next token overwrites. Only the last groups go through the careful byte-counting loop. A flat image decodes at about 9 GB/s, 6 times faster than before.
+
+With `-l`, the long run format is used. Unlike `-m` and `-a`, it is recorded in the data, by a flag of the rANS and range coded formats and by the leading bytes `FF FF FC` before a Huffman stream, so it is not given when decompressing. It keeps the flag bytes and the count byte, but the count `0xFF` is followed by a varint of the repeats past 257 (7 bits per byte, lowest first, the top bit telling that another byte follows). Any run is then a single token, instead of a token per 257 bytes, which leaves fewer symbols to the entropy coder. The worst case of the output stays at `len + ceil(len / 8)`, since an extended run covers at least 257 bytes. The flat `df1h` image with `-m` shrinks from 422 to 24 bytes, and no sample image gets more than a byte larger.
+
 == Model 
 Files: `transform.h` | `transform.c`
 
@@ -61,12 +72,46 @@ Several data structures are required for Huffman coding:
 - *Symbols*: A list of symbols used to construct Huffman codes.
 - *AlphabetMinHeap*: A min-heap implementation using an array.
 - *Codebook*: A list of Huffman codes used for encoding.
-- *HuffmanTree*: A binary tree that stores the Huffman codes for decoding. This structure is heap-allocated.
+- *DecodeTable*: A multi-level lookup table for decoding, an 11-bit primary table plus 5-bit overflow sub-tables for longer codes. Each symbol is resolved with one or two table hits. This structure is heap-allocated in a single block.
 
 Since the maximum size of the data to be stored in these data structures is known beforehand (the size of the alphabet), most of them are stack-allocated, which eliminates the need for dynamic memory allocation.
 
 For simplicity, these data structure implementations are located within `huffman.c`, as they are used directly for Huffman encoding and decoding.
 
+Symbol frequencies are counted by `histogram.c` into four interleaved sub-histograms, so that a run of the same byte does not serialize on a single counter. An AVX2 kernel, selected at runtime, counts 32-byte vectors made of a single value with one addition. Inputs larger than 1 MiB are split across worker threads, and their histograms are merged afterwards. A list of segments is split by its bytes as a whole, so the many small blocks of the adaptive mode are counted in parallel as well.
+
+The single stream encoder splits large inputs the same way. First, every thread sums the code lengths of its part. A prefix sum of these sums gives the bit position where each part starts. The threads then pack their codes directly into the shared output. Bytes that are shared by neighbouring parts are merged in order at the end, so the output is bit-identical to the serial encoder.
+
+Streams without any index, including the legacy ones, can still be decoded in parallel. The decoder splits the coded bits evenly, and every thread starts decoding at its guessed position, most likely in the middle of a code. Canonical prefix codes are self-synchronizing, so each thread continues into the next part until it stands on a code boundary which the next thread has also decoded. From that boundary on, both produce the same symbols, and the parts are stitched together. If the threads do not synchronize, the stream is decoded serially. This mode is picked automatically for large single streams on multi-core machines.
+
+Code lengths are limited to 15 bits by default (at most 32 bits via `HuffmanOptions`). Whenever plain Huffman coding produces a longer code, the lengths are recomputed with the package-merge algorithm, which gives the optimal lengths under the limit. The decoder rejects any code longer than 32 bits.
+
+=== Extended format
+Streams produced with any extension start with the bytes `0xFF 0xFF 0xFF` followed by a byte of format flags. A legacy stream can never start this way, since it would describe the shortest code as 256 bits long. Streams without the magic are decoded as the original single stream format.
+
+- *Interleaved streams* (`-s <n>`): Symbol $i$ is coded into stream $i mod n$, all streams share one codebook and each is terminated by its own EOF. The byte sizes of the first $n-1$ streams are stored as 32-bit values after the codebook, so the decoder can read all streams in lockstep.
+- *Chunks* (`-k <KiB>`): The data is cut into chunks of a fixed size, coded with one shared codebook. Each chunk starts on a byte boundary. The header stores the chunk size (32 bits) and the decoded length (64 bits). The codebook is followed by the 64-bit byte offsets of all chunks but the first. The decoder hands the chunks to a pool of threads, which decode them directly into their place in the output. Combined with `-s`, every chunk contains its own interleaved streams.
+- *Compact table*: The code lengths of all 257 symbols are stored the way DEFLATE stores them. Runs of equal lengths and runs of unused symbols are replaced by repeat codes, and the resulting alphabet of 36 codes is itself Huffman coded with lengths of at most 7 bits. Its 3-bit code lengths come first, ordered so the rarely used lengths can be cut off the end. The encoder uses this table whenever it is smaller than the original one. It is also the only table able to describe an empty input.
+- *Explicit length*: The decoded length is stored in the header as a 64-bit value (shared with the chunk header), and the alphabet is the plain 256 bytes without EOF. The decoder allocates the output once and decodes a known number of symbols, without comparing every one of them against EOF. This is the default, the EOF terminated stream can still be produced through `HuffmanOptions`.
+- *Block tables*: The segments of the input are grouped into runs. The header stores their count (32 bits), and for every run its decoded length (a 6-bit width followed by the length in that many bits) and one bit telling whether it has its own table. A run with its own table stores it in the compact form right before its codes, the other runs use the shared table. The codes of all runs follow each other without padding. Block tables cannot be combined with streams or chunks.
+- *Table map* (`-t <n>`): An extension of block tables. The histograms of the segments are clustered into at most $n$ groups by k-means, the distance being the bits a segment costs under the table of a group. Tables that cost more to store than they save are dropped, and segments that would break a run for only a few bits join their neighbour. The $K$ tables are stored once in the compact form right after the count $K - 1$ (8 bits), the first of them in place of the shared table. Every run then stores a $ceil(log_2 K)$-bit table index instead of the bit telling whether it has its own table. The decoder builds only $K$ decode tables.
+- *Contexts*: Every byte is coded with one of $N <= 8$ tables. The previous byte of the coded data, taken as a signed value, selects the table by the bit width of its magnitude. The coder does not interpret the bytes, so with the model the previous byte is whatever RLE token precedes: a literal residual, which separates the values after a flat area from those after an edge, but just as well a flag byte or a run count, and the 4 bytes of the image header come first. The widest magnitudes share the last table. The first table is stored in place of the shared table, followed by $N - 1$ (8 bits) and the other tables in the compact form. The encoder tries every $N$ and keeps the smallest output. The decoder still resolves every symbol with table lookups, only switching the table in between. Contexts cannot be combined with streams, chunks or block tables.
+- *Pairs* (`-p`): Every symbol stands for two bytes, so nearly constant data is no longer limited to one bit per byte. The dictionary holds up to 256 of the most frequent pairs, ordered by frequency, and is stored after the shared table as its size minus one (8 bits), a bit telling whether an escape symbol follows the pairs, and the pairs themselves (16 bits each). A pair outside of the dictionary is coded as the escape symbol followed by its raw 16 bits, and the last byte of an odd length is stored raw after the codes. The multi-symbol decode table then yields two pairs per lookup. The encoder compresses the data both with pairs and with the requested layout (single table, block tables or contexts), and keeps the smaller output. Pairs cannot be combined with streams or chunks.
+
+== rANS coding
+Files: `ans.h` | `ans.c`
+
+With `-r`, the data is entropy coded with range asymmetric numeral systems (rANS) instead of Huffman coding. A symbol then costs a fractional number of bits, so skewed distributions are no longer rounded up to one bit per byte. On 32 MiB of bytes that are 97% zeros, rANS produces 1.0 MB against 4.4 MB of a single Huffman table, while still decoding about 3.5 times faster than the single table Huffman decoder.
+
+The frequencies are normalized to sum up to $2^12$, and every present byte keeps at least one slot. The stream starts with the bytes `0xFF 0xFF 0xFE`, which neither Huffman format can start with, followed by a flags byte (currently zero) and the 64-bit decoded length. The table stores one bit per byte telling whether it is present, and for a present byte the 4-bit width of its frequency followed by the frequency without its leading one. Byte $i$ is coded by the state $i mod 4$, the four 32-bit states are stored after the table, and the byte-wise renormalization output follows them. Since the states are independent, the decoder interleaves four dependency chains, and every symbol is resolved by a single lookup into a table of $2^12$ packed entries. The decoder checks that the data ends exactly with the initial states. rANS cannot be combined with streams, chunks, tables or pairs.
+
+== Range coding
+Files: `range.h` | `range.c`
+
+With `-x`, the data is entropy coded with an adaptive binary range coder, meant for archiving where the size matters more than the speed. Every byte is coded as 8 binary decisions down a bit tree, most significant bit first, and every node of the tree has its own 12-bit probability in each of the 256 contexts given by the previous byte. A probability moves by $1/4$ of its distance towards the coded bit at first, slowing down with every bit until it moves by $1/32$. The decoder learns the very same probabilities, so no table is stored and the data is not counted beforehand.
+
+The stream starts with the bytes `0xFF 0xFF 0xFD`, a flags byte (currently zero) and the 64-bit decoded length, followed by the bytes of the range coder. The decoder checks that it reads exactly the bytes the encoder has flushed. On the sample images with `-m` and `-m -a`, the output is 4.4% smaller than with Huffman coding in total, while both coding and decoding run at about 20 MB/s. Range coding cannot be combined with streams, chunks, tables, pairs or rANS.
+
 = Data Representation
 The first 2 bytes represent the width of the image, and the next 2 bytes represent the height, meaning the maximum size of the image is $2^16=65536$ pixels for both width and height. Following these bytes is the data section. All parts together are then compressed using Huffman coding.
 
@@ -95,7 +140,7 @@ The entire image buffer is passed directly into Huffman encoding.
 === Model
 Parameter: `-m`
 
-Applies a model (delta encoding) before sending the data to RLE and then Huffman encoding.
+Applies a model (delta encoding) before sending the data to RLE and then Huffman encoding. Without `-a`, the RLE output is Huffman coded with context tables, selected by the previous byte of that output (a residual, a flag byte or a run count), whenever they are smaller than a single table.
 
 === Adaptive
 Parameters: `-a`
@@ -107,7 +152,7 @@ The image is split into blocks with a maximum size of 32x32 pixels, configurable
 + *Vertical*: Image data is serialized vertically.
 + *Circular*: Image data is serialized in a circular/spiral pattern.
 
-All forms except *Raw* are then encoded using the RLE method.
+All forms except *Raw* are then encoded using the RLE method. The forms are compared by their size after Huffman coding, not by the length of the RLE output. The shared table is first estimated from all forms of all blocks, and a form is measured with the table it ends up with: the shared one, or its own one where block tables allow it and that is smaller. The range coder adapts to every block, so its forms are measured with their own table as well. Unless streams or chunks are requested, the blocks are stored with block tables, and `-t <n>` lets them share up to $n$ clustered tables through a table map.
 
 #grid(
   columns: 3,
@@ -131,6 +176,8 @@ Since there are four forms, 2 bits of metadata overhead are needed for each bloc
 
 The metadata group is stored first, followed by the block data.
 
+Blocks with statistics different from the rest of the image (a sky next to a texture) may carry their own Huffman table. A block gets its own table when the codes and the table together are smaller than the block coded with the shared table, and consecutive blocks using the shared table are merged into one run.
+
 === Adaptive Model
 Parameter: `-m -a`
 
@@ -0,0 +1,352 @@
+/**
+ * @file ans.c
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Implementation of `ans.h`
+ */
+
+#include "ans.h"
+#include "histogram.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// Leading bytes of the rANS format. A legacy Huffman stream never starts with them, that would
+/// describe 256 symbols where the first (shortest) code is 255 bits long.
+#define ANS_MAGIC 0xFEFFFF
+
+#define ANS_TOTAL (1 << ANS_SCALE_BITS)
+#define ANS_MASK (ANS_TOTAL - 1)
+
+/// Lower bound of a normalized state, the states are renormalized a byte at a time
+#define ANS_LOWER_BOUND (1u << 23)
+
+/// Bits of the width of a stored frequency
+#define ANS_WIDTH_BITS 4
+
+typedef struct {
+    uint16_t freq[HISTOGRAM_LEN]; ///< Normalized frequencies, summing up to `ANS_TOTAL`
+    uint16_t start[HISTOGRAM_LEN]; ///< Sum of the frequencies of the preceding symbols
+} AnsTable;
+
+/// Decoding step of one slot of the cumulative frequencies, packed into a word so the table stays small:
+/// frequency minus one, position of the slot within the slots of its symbol, and the symbol
+typedef uint32_t AnsDecodeEntry;
+
+void ans_table_normalize(AnsTable *table, uint64_t freq[HISTOGRAM_LEN], size_t len);
+void ans_table_encode(AnsTable *table, BitArray *output);
+void ans_table_decode(AnsTable *table, BitArray *input);
+void ans_encode(SegmentList *input, AnsTable *table, size_t len, BitArray *output);
+void ans_decode(AnsTable *table, uint8_t *bytes, size_t nof_bytes, uint8_t *output, size_t len);
+
+BitArray ans_compress(uint8_t *bytes, size_t len) {
+    SegmentList input = segment_list_new();
+    SegmentList output = segment_list_new();
+    BitArray result = bit_array_new(NULL, 0);
+
+    segment_list_push_bytes(&input, bytes, len);
+    if (!got_error()) {
+        ans_compress_segments(&input, 0, &output);
+    }
+
+    if (!got_error()) {
+        result = segment_list_join(&output);
+    }
+
+    segment_list_free(&input);
+    segment_list_free(&output);
+
+    return result;
+}
+
+void ans_compress_segments(SegmentList *input, uint8_t flags, SegmentList *output) {
+    BitArray result = bit_array_new(NULL, 0);
+    uint64_t freq[HISTOGRAM_LEN] = {0};
+    size_t len = segment_list_byte_len(input);
+
+    histogram_count_segments(freq, input);
+
+    AnsTable table;
+    ans_table_normalize(&table, freq, len);
+
+    bit_array_push_n(&result, ANS_MAGIC, 24);
+    bit_array_push_n(&result, flags, 8);
+    bit_array_push_n(&result, len, 64);
+
+    if (len) {
+        ans_table_encode(&table, &result);
+    }
+
+    /// The states are renormalized by whole bytes
+    bit_array_pad_to_byte(&result);
+
+    if (len && !got_error()) {
+        ans_encode(input, &table, len, &result);
+    }
+
+    if (got_error()) {
+        bit_array_free(&result);
+        return;
+    }
+
+    logfmt("Compressed to %ld bytes", bit_array_byte_len(&result));
+    segment_list_push(output, &result);
+}
+
+BitArray ans_decompress(uint8_t *bytes, size_t len) {
+    BitArray input = bit_array_new(bytes, len);
+    BitArray result = bit_array_new(NULL, 0);
+
+    if (!got_error() && !ans_has_magic(bytes, len)) {
+        fprintf(stderr, "ERR ans_decompress: Data is not rANS coded\n");
+        set_error(Error_InvalidFormat);
+    }
+
+    input.cursor = 24;
+    uint8_t flags = got_error() ? 0 : bit_array_read_n(&input, 8);
+    size_t decoded_len = got_error() ? 0 : bit_array_read_n(&input, 64);
+
+    if (!got_error() && flags & ~ANS_FLAG_LONG_RUNS) {
+        fprintf(stderr, "ERR ans_decompress: Unknown format flags 0x%02X\n", flags);
+        set_error(Error_InvalidFormat);
+    }
+
+    AnsTable table = {0};
+    if (!got_error() && decoded_len) {
+        ans_table_decode(&table, &input);
+    }
+
+    /// A symbol takes at least 1/ANS_TOTAL of a bit unless it is the only one, this keeps a broken header from allocating too much
+    size_t offset = (input.cursor + 7) / 8;
+    bool is_single = false;
+    for (size_t s = 0; s < HISTOGRAM_LEN; s++) {
+        is_single = is_single || table.freq[s] == ANS_TOTAL;
+    }
+
+    if (!got_error() && !is_single && decoded_len / ANS_TOTAL > (len - offset) * 8) {
+        fprintf(stderr, "ERR ans_decompress: Length of %ld bytes is out of the data\n", decoded_len);
+        set_error(Error_InvalidFormat);
+    }
+
+    if (!got_error()) {
+        bit_array_reserve(&result, decoded_len);
+    }
+
+    if (!got_error() && decoded_len) {
+        ans_decode(&table, bytes + offset, len - offset, result.data, decoded_len);
+    }
+
+    if (!got_error()) {
+        result.len = decoded_len * 8;
+    } else {
+        bit_array_free(&result);
+    }
+
+    bit_array_free(&input);
+    return result;
+}
+
+uint8_t ans_flags(uint8_t *bytes, size_t len) {
+    return ans_has_magic(bytes, len) ? bytes[3] : 0;
+}
+
+bool ans_has_magic(uint8_t *bytes, size_t len) {
+    return len >= 4 && bytes[0] == 0xFF && bytes[1] == 0xFF && bytes[2] == 0xFE;
+}
+
+void ans_table_normalize(AnsTable *table, uint64_t freq[HISTOGRAM_LEN], size_t len) {
+    memset(table, 0, sizeof(AnsTable));
+    if (!len) return;
+
+    size_t sum = 0;
+    size_t largest = 0;
+
+    for (size_t s = 0; s < HISTOGRAM_LEN; s++) {
+        if (!freq[s]) continue;
+
+        /// Every present symbol keeps at least one slot
+        size_t scaled = (freq[s] * ANS_TOTAL + len / 2) / len;
+        table->freq[s] = scaled ? scaled : 1;
+        sum += table->freq[s];
+
+        if (freq[s] > freq[largest]) largest = s;
+    }
+
+    /// The rounding error is given to the most frequent symbol, or taken from the ones with the most slots
+    if (sum < ANS_TOTAL) {
+        table->freq[largest] += ANS_TOTAL - sum;
+        sum = ANS_TOTAL;
+    }
+
+    while (sum > ANS_TOTAL) {
+        size_t widest = 0;
+        for (size_t s = 1; s < HISTOGRAM_LEN; s++) {
+            if (table->freq[s] > table->freq[widest]) widest = s;
+        }
+
+        size_t taken = sum - ANS_TOTAL < table->freq[widest] - 1u ? sum - ANS_TOTAL : table->freq[widest] - 1u;
+        table->freq[widest] -= taken;
+        sum -= taken;
+    }
+
+    for (size_t s = 1; s < HISTOGRAM_LEN; s++) {
+        table->start[s] = table->start[s - 1] + table->freq[s - 1];
+    }
+}
+
+void ans_table_encode(AnsTable *table, BitArray *output) {
+    /// Presence bit, then the width of the frequency and its bits below the leading one
+    for (size_t s = 0; s < HISTOGRAM_LEN; s++) {
+        uint16_t freq = table->freq[s];
+        bit_array_push_n(output, freq != 0, 1);
+        if (!freq) continue;
+
+        size_t width = 0;
+        while (freq >> width) {
+            width += 1;
+        }
+
+        bit_array_push_n(output, width - 1, ANS_WIDTH_BITS);
+        bit_array_push_n(output, freq, width - 1);
+    }
+}
+
+void ans_table_decode(AnsTable *table, BitArray *input) {
+    size_t sum = 0;
+    memset(table, 0, sizeof(AnsTable));
+
+    for (size_t s = 0; s < HISTOGRAM_LEN; s++) {
+        if (!bit_array_read_n(input, 1)) continue;
+
+        size_t width = bit_array_read_n(input, ANS_WIDTH_BITS) + 1;
+        size_t freq = ((size_t)1 << (width - 1)) | bit_array_read_n(input, width - 1);
+        if (got_error()) return;
+
+        if (freq > ANS_TOTAL - sum) {
+            fprintf(stderr, "ERR ans_decompress: Frequencies exceed %d\n", ANS_TOTAL);
+            set_error(Error_InvalidFormat);
+            return;
+        }
+
+        table->freq[s] = freq;
+        table->start[s] = sum;
+        sum += freq;
+    }
+
+    if (sum != ANS_TOTAL) {
+        fprintf(stderr, "ERR ans_decompress: Frequencies do not sum up to %d\n", ANS_TOTAL);
+        set_error(Error_InvalidFormat);
+    }
+}
+
+void ans_encode(SegmentList *input, AnsTable *table, size_t len, BitArray *output) {
+    /// A symbol emits at most ANS_SCALE_BITS bits, plus the final states
+    size_t capacity = len * ((ANS_SCALE_BITS + 7) / 8) + 4 * ANS_NOF_STATES;
+    uint8_t *buffer = malloc(capacity);
+    if (!buffer) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    uint8_t *ptr = buffer + capacity;
+    uint32_t states[ANS_NOF_STATES];
+
+    for (size_t j = 0; j < ANS_NOF_STATES; j++) {
+        states[j] = ANS_LOWER_BOUND;
+    }
+
+    /// Coded from the end, so the decoder goes forwards. Symbol `i` belongs to the state `i % ANS_NOF_STATES`.
+    size_t i = len;
+    for (size_t s = input->size; s-- > 0;) {
+        uint8_t *bytes = input->items[s].data;
+
+        for (size_t k = input->items[s].len; k-- > 0;) {
+            uint32_t *state = &states[--i % ANS_NOF_STATES];
+            uint32_t freq = table->freq[bytes[k]];
+            uint32_t max_state = ((ANS_LOWER_BOUND >> ANS_SCALE_BITS) << 8) * freq;
+
+            while (*state >= max_state) {
+                *--ptr = *state & 0xFF;
+                *state >>= 8;
+            }
+
+            *state = ((*state / freq) << ANS_SCALE_BITS) + *state % freq + table->start[bytes[k]];
+        }
+    }
+
+    /// The first state ends up first, little endian
+    for (size_t j = ANS_NOF_STATES; j-- > 0;) {
+        ptr -= 4;
+        for (size_t b = 0; b < 4; b++) {
+            ptr[b] = states[j] >> (8 * b);
+        }
+    }
+
+    size_t nof_bytes = buffer + capacity - ptr;
+    bit_array_reserve(output, nof_bytes);
+
+    if (!got_error()) {
+        memcpy(output->data + bit_array_byte_len(output), ptr, nof_bytes);
+        output->len += nof_bytes * 8;
+    }
+
+    free(buffer);
+}
+
+void ans_decode(AnsTable *table, uint8_t *bytes, size_t nof_bytes, uint8_t *output, size_t len) {
+    AnsDecodeEntry entries[ANS_TOTAL];
+    uint32_t states[ANS_NOF_STATES] = {0};
+    size_t pos = 4 * ANS_NOF_STATES;
+
+    for (size_t s = 0; s < HISTOGRAM_LEN; s++) {
+        for (size_t slot = 0; slot < table->freq[s]; slot++) {
+            entries[table->start[s] + slot] = (table->freq[s] - 1) | slot << ANS_SCALE_BITS | s << (2 * ANS_SCALE_BITS);
+        }
+    }
+
+    if (nof_bytes < pos) {
+        fprintf(stderr, "ERR ans_decompress: States are out of the data\n");
+        set_error(Error_IndexOutOfBound);
+        return;
+    }
+
+    for (size_t j = 0; j < ANS_NOF_STATES; j++) {
+        for (size_t b = 0; b < 4; b++) {
+            states[j] |= (uint32_t)bytes[4 * j + b] << (8 * b);
+        }
+    }
+
+    /// Reading past the end shifts in zeros, it is detected once at the end.
+    /// Every round advances all the states, so their dependency chains overlap.
+    for (size_t i = 0; i < len; i += ANS_NOF_STATES) {
+        size_t nof_symbols = len - i < ANS_NOF_STATES ? len - i : ANS_NOF_STATES;
+
+        for (size_t j = 0; j < nof_symbols; j++) {
+            AnsDecodeEntry entry = entries[states[j] & ANS_MASK];
+            uint32_t freq = (entry & ANS_MASK) + 1;
+            uint32_t offset = (entry >> ANS_SCALE_BITS) & ANS_MASK;
+
+            output[i + j] = entry >> (2 * ANS_SCALE_BITS);
+            states[j] = freq * (states[j] >> ANS_SCALE_BITS) + offset;
+
+            while (states[j] < ANS_LOWER_BOUND) {
+                states[j] = (states[j] << 8) | (pos < nof_bytes ? bytes[pos] : 0);
+                pos += 1;
+            }
+        }
+    }
+
+    /// Decoding ends with the initial states of the encoder exactly at the end of the data
+    bool is_initial = true;
+    for (size_t k = 0; k < ANS_NOF_STATES; k++) {
+        is_initial = is_initial && states[k] == ANS_LOWER_BOUND;
+    }
+
+    if (pos > nof_bytes) {
+        fprintf(stderr, "ERR ans_decompress: Data ends before its length\n");
+        set_error(Error_IndexOutOfBound);
+    } else if (pos < nof_bytes || !is_initial) {
+        fprintf(stderr, "ERR ans_decompress: Data does not match its length\n");
+        set_error(Error_InvalidFormat);
+    }
+}
@@ -0,0 +1,72 @@
+/**
+ * @file ans.h
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Interleaved rANS coding, an alternative entropy coder to `huffman.h`
+ */
+
+#ifndef ANS_H
+#define ANS_H
+
+#include "bit_array.h"
+#include "segments.h"
+
+/// Precision of the normalized frequencies, they sum up to `1 << ANS_SCALE_BITS`
+#define ANS_SCALE_BITS 12
+
+/// Number of interleaved rANS states, consecutive symbols alternate between them
+#define ANS_NOF_STATES 4
+
+/// Format flag of the data, it is run-length encoded with runs of any length (`RleFormat_Long`)
+#define ANS_FLAG_LONG_RUNS 0x01
+
+/**
+ * @brief Compresses data using rANS with a normalized frequency table.
+ *
+ * Unlike Huffman coding, a symbol is not limited to a whole number of bits, which pays off for
+ * skewed distributions. The stream starts with its own magic, so it can be told apart from both
+ * Huffman formats.
+ *
+ * @param bytes Pointer to the byte array to be compressed.
+ * @param len Length of the byte array.
+ * @return BitArray The compressed data.
+ */
+BitArray ans_compress(uint8_t *bytes, size_t len);
+
+/**
+ * @brief Compresses a chain of segments as one stream, without joining them first.
+ *
+ * @param input Pointer to the segments of the data to be compressed.
+ * @param flags Format flags of the data (`ANS_FLAG_*`), stored for its decoder.
+ * @param output Pointer to the list the compressed data is appended to.
+ */
+void ans_compress_segments(SegmentList *input, uint8_t flags, SegmentList *output);
+
+/**
+ * @brief Decompresses data compressed by `ans_compress`.
+ *
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return BitArray The decompressed data.
+ */
+BitArray ans_decompress(uint8_t *bytes, size_t len);
+
+/**
+ * @brief Checks whether the data starts as a stream of `ans_compress`.
+ *
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return true if the data is rANS coded.
+ */
+bool ans_has_magic(uint8_t *bytes, size_t len);
+
+/**
+ * @brief Reads the format flags of the data stored by `ans_compress_segments`.
+ *
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return The `ANS_FLAG_*` flags, 0 if the data is not rANS coded.
+ */
+uint8_t ans_flags(uint8_t *bytes, size_t len);
+
+#endif
@@ -19,10 +19,17 @@ Args args_parse(int argc, char **argv) {
     args.transformace_data = false;
     args.width = 0;
     args.block_size = 128; // Default to 128x128 per block
+    args.nof_streams = 1; // Default to the single stream format
+    args.chunk_size = 0; // Default to a single chunk
+    args.nof_tables = 0; // Default to a table per block where it pays off
+    args.has_pairs = false;
+    args.is_ans = false;
+    args.is_range = false;
+    args.has_long_runs = false;
     args.mode = Mode_Compress; // Default mode is compress
 
     int opt;
-    while ((opt = getopt(argc, argv, "cdmaw:i:o:b:h")) != -1) {
+    while ((opt = getopt(argc, argv, "cdmaprxlw:i:o:b:s:k:t:h")) != -1) {
         switch (opt) {
             case 'c':
                 args.mode = Mode_Compress;
@@ -36,12 +43,33 @@ Args args_parse(int argc, char **argv) {
             case 'a':
                 args.image_adaptive = true;
                 break;
+            case 'p':
+                args.has_pairs = true;
+                break;
+            case 'r':
+                args.is_ans = true;
+                break;
+            case 'x':
+                args.is_range = true;
+                break;
+            case 'l':
+                args.has_long_runs = true;
+                break;
             case 'w':
                 args.width = atoi(optarg);
                 break;
             case 'b':
                 args.block_size = atoi(optarg);
                 break;
+            case 's':
+                args.nof_streams = atoi(optarg);
+                break;
+            case 'k':
+                args.chunk_size = atoi(optarg);
+                break;
+            case 't':
+                args.nof_tables = atoi(optarg);
+                break;
             case 'i':
                 args.filename = optarg;
                 break;
@@ -77,5 +105,40 @@ Args args_parse(int argc, char **argv) {
         fprintf(stderr, "Error: Invalid block size.\n");
     }
 
+    if (args.nof_streams < 1 || args.nof_streams > 256) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: Number of streams must be between 1 and 256.\n");
+    }
+
+    if (args.chunk_size < 0 || args.chunk_size > 1024 * 1024) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: Chunk size must be between 0 and 1048576 KiB.\n");
+    }
+
+    if (args.nof_tables < 0 || args.nof_tables > 256) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: Number of tables must be between 0 and 256.\n");
+    }
+
+    if (args.nof_tables && !args.image_adaptive) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: Tables require the adaptive mode (-a).\n");
+    }
+
+    if (args.has_pairs && (args.nof_streams > 1 || args.chunk_size)) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: Pairs cannot be combined with streams or chunks.\n");
+    }
+
+    if (args.is_ans && (args.nof_streams > 1 || args.chunk_size || args.nof_tables || args.has_pairs)) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: rANS cannot be combined with streams, chunks, tables or pairs.\n");
+    }
+
+    if (args.is_range && (args.nof_streams > 1 || args.chunk_size || args.nof_tables || args.has_pairs || args.is_ans)) {
+        set_error(Error_InvalidArgument);
+        fprintf(stderr, "Error: Range coding cannot be combined with streams, chunks, tables, pairs or rANS.\n");
+    }
+
     return args;
 }
@@ -29,6 +29,13 @@ typedef struct {
     bool transformace_data; /**< Flag indicating whether data transformation is activated */
     uint32_t width; /**< Width of the image */
     int block_size; /**< Block size for adaptive image scanning */
+    int nof_streams; /**< Number of interleaved Huffman streams */
+    int chunk_size; /**< Size of independently decodable Huffman chunks in KiB, 0 for a single chunk */
+    int nof_tables; /**< Number of Huffman tables clustered from the blocks of the adaptive mode, 0 for a table per block */
+    bool has_pairs; /**< Flag indicating whether pairs of bytes may be Huffman coded as one symbol */
+    bool is_ans; /**< Flag indicating whether the data is entropy coded with rANS instead of Huffman coding */
+    bool is_range; /**< Flag indicating whether the data is entropy coded with an adaptive range coder instead of Huffman coding */
+    bool has_long_runs; /**< Flag indicating whether RLE runs of any length are stored as a single token */
     Mode mode; /**< Mode of operation (compression or decompression) */
     bool is_help; /**< Flag indicating whether the help message should be displayed */
 } Args;
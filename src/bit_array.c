@@ -10,7 +10,16 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define BYTE_CHUNK 10
+/// Smallest capacity allocated by a growing bit array
+#define BYTE_CHUNK 16
+
+void bit_array_realloc(BitArray *arr, size_t capacity);
+void bit_array_grow(BitArray *arr, size_t capacity);
+void bit_writer_store(BitWriter *writer, size_t nof_bytes);
+uint64_t load_le64(const uint8_t *bytes);
+void store_le64(uint8_t *bytes, uint64_t value);
+uint64_t bit_array_word_at(BitArray *arr, size_t index);
+void bit_reader_refill(BitReader *reader);
 
 BitArray bit_array_new(uint8_t *bytes, size_t len) {
     BitArray arr = {0};
@@ -50,6 +59,50 @@ size_t bit_array_byte_len(BitArray *arr) {
     return (arr->len / 8) + (bool)(arr->len % 8);
 }
 
+void bit_array_reserve(BitArray *arr, size_t nof_bytes) {
+    size_t capacity = bit_array_byte_len(arr) + nof_bytes;
+
+    if (capacity > arr->capacity) {
+        bit_array_realloc(arr, capacity);
+    }
+}
+
+void bit_array_shrink_to_fit(BitArray *arr) {
+    size_t len = bit_array_byte_len(arr);
+
+    if (len == arr->capacity) {
+        return;
+    }
+
+    if (!len) {
+        free(arr->data);
+        arr->data = NULL;
+        arr->capacity = 0;
+        return;
+    }
+
+    uint8_t *new_data = realloc(arr->data, len);
+
+    if (!new_data) {
+        fprintf(stderr, "ERR bit array: Cannot allocate memory\n");
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    arr->data = new_data;
+    arr->capacity = len;
+}
+
+/// Grow to at least `capacity` bytes, doubling so that appending is amortized O(1)
+void bit_array_grow(BitArray *arr, size_t capacity) {
+    size_t new_capacity = arr->capacity * 2;
+
+    if (new_capacity < capacity) new_capacity = capacity;
+    if (new_capacity < BYTE_CHUNK) new_capacity = BYTE_CHUNK;
+
+    bit_array_realloc(arr, new_capacity);
+}
+
 void bit_array_realloc(BitArray *arr, size_t capacity) {
     uint8_t *new_data = realloc(arr->data, capacity);
 
@@ -59,8 +112,8 @@ void bit_array_realloc(BitArray *arr, size_t capacity) {
         return;
     }
 
-    /// Set new data to 0
-    size_t byte_index = arr->len / 8;
+    /// Set new data to 0, keeping the partially filled byte
+    size_t byte_index = bit_array_byte_len(arr);
     memset(new_data + byte_index, 0, capacity - byte_index);
 
     arr->data = new_data;
@@ -73,7 +126,7 @@ void bit_array_push(BitArray *arr, bool is_one) {
     size_t bit_index = arr->len % 8;
 
     if (bit_index == 0 && byte_index >= arr->capacity) {
-        bit_array_realloc(arr, arr->capacity + BYTE_CHUNK);
+        bit_array_grow(arr, byte_index + 1);
         if (got_error()) return;
     }
 
@@ -100,7 +153,7 @@ void bit_array_push_n(BitArray *arr, uint64_t data, size_t n) {
     size_t len = arr->len + n;
     size_t expected_bytes = len / 8 + (bool)(len % 8);
     if (expected_bytes > arr->capacity) {
-        bit_array_realloc(arr, expected_bytes + BYTE_CHUNK);
+        bit_array_grow(arr, expected_bytes);
         if (got_error()) {
             return;
         }
@@ -161,17 +214,44 @@ void bit_array_pad_to_byte(BitArray *arr) {
 
 void bit_array_concat(BitArray *arr, BitArray *other) {
     size_t len = other->len;
+    if (!len) return;
 
-    while (len) {
-        size_t nof_bits = 16;
-        if (len < nof_bits) {
-            nof_bits = len;
+    size_t expected_bytes = (arr->len + len + 7) / 8;
+    if (expected_bytes > arr->capacity) {
+        bit_array_grow(arr, expected_bytes);
+        if (got_error()) return;
+    }
+
+    size_t nof_bytes = bit_array_byte_len(other);
+    size_t shift = arr->len % 8;
+    uint8_t *dst = arr->data + arr->len / 8;
+    uint8_t *src = other->data;
+
+    if (!shift) {
+        memcpy(dst, src, nof_bytes);
+    } else {
+        /// Shift every word into place and carry its top bits over to the next one
+        uint64_t carry = dst[0];
+        size_t i = 0;
+
+        for (; i + 8 <= nof_bytes; i += 8) {
+            uint64_t word = load_le64(src + i);
+            store_le64(dst + i, (word << shift) | carry);
+            carry = word >> (64 - shift);
         }
 
-        uint64_t val = bit_array_read_n(other, nof_bits);
-        bit_array_push_n(arr, val, nof_bits);
-        len -= nof_bits;
+        for (; i < nof_bytes; i++) {
+            dst[i] = (src[i] << shift) | carry;
+            carry = src[i] >> (8 - shift);
+        }
+
+        /// The carried bits only need their own byte when they are part of the data
+        if (arr->len / 8 + nof_bytes < expected_bytes) {
+            dst[nof_bytes] = carry;
+        }
     }
+
+    arr->len += len;
 }
 
 int bit_array_read(BitArray *arr) {
@@ -202,22 +282,200 @@ uint64_t bit_array_read_n(BitArray *arr, size_t n) {
         return 0;
     }
 
-    uint64_t result = 0;
-    for (size_t i = 0; i < n; i++) {
-        int bit = bit_array_read(arr);
-        if (bit == 2) {
-            // End of bit array
-            return result;
-        }
+    /// Single bounds check, only the available bits are read at the end of the array
+    size_t available = arr->cursor < arr->len ? arr->len - arr->cursor : 0;
+    if (n > available) {
+        set_error(Error_IndexOutOfBound);
+        n = available;
+    }
 
-        result |= (bit << i);
+    if (!n) return 0;
+
+    uint64_t result;
+    if (n <= 56) {
+        result = bit_array_word_at(arr, arr->cursor) & ((1ULL << n) - 1);
+    } else {
+        uint64_t high = bit_array_word_at(arr, arr->cursor + 32) & ((1ULL << (n - 32)) - 1);
+        result = (bit_array_word_at(arr, arr->cursor) & 0xFFFFFFFF) | (high << 32);
     }
 
+    arr->cursor += n;
+
     logfmt("bit_array_read_n: got %ld", result);
 
     return result;
 }
 
+uint64_t load_le64(const uint8_t *bytes) {
+    /// Compilers merge this into a single unaligned load on little endian targets
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t)bytes[i] << (i * 8);
+    }
+
+    return value;
+}
+
+void store_le64(uint8_t *bytes, uint64_t value) {
+    for (size_t i = 0; i < 8; i++) {
+        bytes[i] = value >> (i * 8);
+    }
+}
+
+/// At least 57 bits starting at the bit `index`, zero past the end of the array
+uint64_t bit_array_word_at(BitArray *arr, size_t index) {
+    size_t byte_index = index / 8;
+    size_t nof_bytes = bit_array_byte_len(arr);
+    uint64_t value = 0;
+
+    if (byte_index + 8 <= nof_bytes) {
+        value = load_le64(arr->data + byte_index);
+    } else {
+        for (size_t i = byte_index; i < nof_bytes; i++) {
+            value |= (uint64_t)arr->data[i] << ((i - byte_index) * 8);
+        }
+    }
+
+    return value >> (index % 8);
+}
+
+BitReader bit_reader_new(BitArray *arr) {
+    BitReader reader = {0};
+
+    /// Guard bytes so that a word can be loaded at any byte of the data
+    bit_array_reserve(arr, BIT_READER_GUARD);
+    if (got_error()) return reader;
+
+    reader.data = arr->data;
+    reader.nof_bytes = bit_array_byte_len(arr);
+    reader.len = arr->len;
+    reader.cursor = arr->cursor;
+    bit_reader_refill(&reader);
+
+    return reader;
+}
+
+BitReader bit_reader_sub(BitReader *reader, size_t byte_offset, size_t nof_bytes) {
+    BitReader sub = {
+        .data = reader->data + byte_offset,
+        .nof_bytes = nof_bytes,
+        .len = nof_bytes * 8,
+        .cursor = 0,
+    };
+
+    bit_reader_refill(&sub);
+
+    return sub;
+}
+
+void bit_reader_seek(BitReader *reader, size_t cursor) {
+    reader->cursor = cursor;
+    bit_reader_refill(reader);
+}
+
+void bit_reader_refill(BitReader *reader) {
+    size_t byte_index = reader->cursor / 8;
+
+    if (byte_index < reader->nof_bytes) {
+        reader->buffer = load_le64(reader->data + byte_index) >> (reader->cursor % 8);
+    } else {
+        reader->buffer = 0;
+    }
+
+    reader->count = 64 - reader->cursor % 8;
+}
+
+uint64_t bit_reader_peek(BitReader *reader, size_t n) {
+    if (reader->count < n) {
+        bit_reader_refill(reader);
+    }
+
+    return reader->buffer & ((1ULL << n) - 1);
+}
+
+void bit_reader_consume(BitReader *reader, size_t n) {
+    reader->buffer >>= n;
+    reader->count -= n;
+    reader->cursor += n;
+}
+
+uint64_t bit_reader_read(BitReader *reader, size_t n) {
+    uint64_t result;
+
+    if (n > 32) {
+        result = bit_reader_peek(reader, 32);
+        bit_reader_consume(reader, 32);
+        result |= bit_reader_peek(reader, n - 32) << 32;
+        bit_reader_consume(reader, n - 32);
+    } else {
+        result = bit_reader_peek(reader, n);
+        bit_reader_consume(reader, n);
+    }
+
+    if (bit_reader_overrun(reader)) {
+        set_error(Error_IndexOutOfBound);
+    }
+
+    return result;
+}
+
+bool bit_reader_overrun(BitReader *reader) {
+    return reader->cursor > reader->len;
+}
+
+BitWriter bit_writer_new(BitArray *arr, size_t nof_bits) {
+    BitWriter writer = {
+        .arr = arr,
+        .index = arr->len / 8,
+        .buffer = 0,
+        .count = arr->len % 8,
+    };
+
+    /// Extra word of room so that the last store never goes out of the buffer
+    bit_array_reserve(arr, (arr->len % 8 + nof_bits + 7) / 8 + 8);
+    if (got_error()) return writer;
+
+    /// Continue the partially filled byte
+    if (writer.count) {
+        writer.buffer = arr->data[writer.index];
+    }
+
+    return writer;
+}
+
+void bit_writer_store(BitWriter *writer, size_t nof_bytes) {
+    if (writer->index + nof_bytes > writer->arr->capacity) {
+        fprintf(stderr, "ERR bit writer: Writing more than reserved\n");
+        set_error(Error_IndexOutOfBound);
+        return;
+    }
+
+    uint8_t *data = writer->arr->data + writer->index;
+    for (size_t i = 0; i < nof_bytes; i++) {
+        data[i] = writer->buffer >> (i * 8);
+    }
+}
+
+void bit_writer_push(BitWriter *writer, uint64_t data, size_t n) {
+    writer->buffer |= data << writer->count;
+    writer->count += n;
+
+    if (writer->count >= 64) {
+        bit_writer_store(writer, 8);
+        writer->index += 8;
+        writer->count -= 64;
+        /// Bits that did not fit into the stored word, `n` is never 64 so the shift is defined
+        writer->buffer = data >> (n - writer->count);
+    }
+}
+
+void bit_writer_finish(BitWriter *writer) {
+    bit_writer_store(writer, (writer->count + 7) / 8);
+    if (got_error()) return;
+
+    writer->arr->len = writer->index * 8 + writer->count;
+}
+
 void bit_array_set_one_at(BitArray *arr, size_t index) {
     if (index >= arr->len) {
         set_error(Error_IndexOutOfBound);
@@ -22,6 +22,34 @@ typedef struct {
     size_t capacity; /**< Capacity in byte. */
 } BitArray;
 
+/// Number of bytes past the end of the data that a BitReader may load
+#define BIT_READER_GUARD 8
+
+/**
+ * @brief Reads a bit array through a 64-bit buffer refilled with unaligned word loads.
+ *
+ * The bounds are only checked when the buffer is refilled, reading past the end is
+ * detected afterwards with `bit_reader_overrun`.
+ */
+typedef struct {
+    uint8_t *data; /**< Data followed by at least `BIT_READER_GUARD` readable bytes */
+    size_t nof_bytes; /**< Number of bytes of the data */
+    size_t len; /**< Length of the data in bits */
+    size_t cursor; /**< Index of the next unread bit */
+    uint64_t buffer; /**< Upcoming bits starting at the cursor, LSB first */
+    size_t count; /**< Number of valid bits in the buffer */
+} BitReader;
+
+/**
+ * @brief Appends codes to a bit array through a 64-bit accumulator, flushed 8 bytes at a time.
+ */
+typedef struct {
+    BitArray *arr; /**< Bit array being written to */
+    size_t index; /**< Byte index where the next word is stored */
+    uint64_t buffer; /**< Pending bits, LSB first */
+    size_t count; /**< Number of pending bits in the buffer */
+} BitWriter;
+
 /**
  * @brief Creates a new bit array from the given byte array.
  *
@@ -38,6 +66,21 @@ BitArray bit_array_new(uint8_t *bytes, size_t len);
  */
 void bit_array_free(BitArray *arr);
 
+/**
+ * @brief Makes sure that at least `nof_bytes` more bytes can be appended without reallocation.
+ *
+ * @param arr Pointer to the BitArray structure.
+ * @param nof_bytes Number of bytes to reserve past the current length.
+ */
+void bit_array_reserve(BitArray *arr, size_t nof_bytes);
+
+/**
+ * @brief Releases the capacity that is not used by the data.
+ *
+ * @param arr Pointer to the BitArray structure.
+ */
+void bit_array_shrink_to_fit(BitArray *arr);
+
 /**
  * @brief Returns the total number of bits in the bit array.
  *
@@ -82,6 +125,9 @@ void bit_array_pad_to_byte(BitArray *arr);
 /**
  * @brief Concatenates the given bit array with the current bit array.
  *
+ * All bits of `other` are appended regardless of its cursor, with a `memcpy` when the
+ * current bit array ends on a byte boundary and a 64-bit shift-and-merge otherwise.
+ *
  * @param arr Pointer to the BitArray structure.
  * @param other Pointer to the BitArray structure to be concatenated.
  */
@@ -113,4 +159,93 @@ uint64_t bit_array_read_n(BitArray *arr, size_t n);
  */
 void bit_array_set_one_at(BitArray *arr, size_t index);
 
+/**
+ * @brief Creates a reader starting at the cursor of the bit array.
+ *
+ * @param arr Pointer to the BitArray structure, its capacity is extended by the guard bytes.
+ * @return BitReader structure reading the bit array.
+ * @note The reader is invalidated by any later modification of the bit array.
+ */
+BitReader bit_reader_new(BitArray *arr);
+
+/**
+ * @brief Creates a reader over a byte range of another reader.
+ *
+ * @param reader Pointer to the parent BitReader structure.
+ * @param byte_offset Offset of the range in bytes, the range must be within the parent.
+ * @param nof_bytes Length of the range in bytes.
+ * @return BitReader structure reading the range, the bits past its end are not guaranteed to be zero.
+ */
+BitReader bit_reader_sub(BitReader *reader, size_t byte_offset, size_t nof_bytes);
+
+/**
+ * @brief Moves the reader to an arbitrary bit position.
+ *
+ * @param reader Pointer to the BitReader structure.
+ * @param cursor Bit position of the next read.
+ */
+void bit_reader_seek(BitReader *reader, size_t cursor);
+
+/**
+ * @brief Returns the upcoming bits without consuming them.
+ *
+ * @param reader Pointer to the BitReader structure.
+ * @param n Number of bits to peek (up to 56).
+ * @return The bits, first bit in the LSB.
+ */
+uint64_t bit_reader_peek(BitReader *reader, size_t n);
+
+/**
+ * @brief Skips over bits that have been peeked.
+ *
+ * @param reader Pointer to the BitReader structure.
+ * @param n Number of bits to consume, at most the number of the last peeked bits.
+ */
+void bit_reader_consume(BitReader *reader, size_t n);
+
+/**
+ * @brief Reads up to 64 bits from the reader.
+ *
+ * @param reader Pointer to the BitReader structure.
+ * @param n Number of bits to read (up to 64).
+ * @return Unsigned 64-bit integer containing the read bits.
+ * @note This will raise an error when reading past the end.
+ */
+uint64_t bit_reader_read(BitReader *reader, size_t n);
+
+/**
+ * @brief Checks whether more bits were consumed than the data contains.
+ *
+ * @param reader Pointer to the BitReader structure.
+ * @return true if the cursor is past the end of the data.
+ */
+bool bit_reader_overrun(BitReader *reader);
+
+/**
+ * @brief Creates a writer appending to the end of the bit array.
+ *
+ * @param arr Pointer to the BitArray structure.
+ * @param nof_bits Exact number of bits that will be written, the memory is reserved up front.
+ * @return BitWriter structure writing into the bit array.
+ */
+BitWriter bit_writer_new(BitArray *arr, size_t nof_bits);
+
+/**
+ * @brief Appends up to 32 bits to the writer.
+ *
+ * @param writer Pointer to the BitWriter structure.
+ * @param data An integer containing the bits to be appended, the bits above `n` must be zero.
+ * @param n Number of bits to be appended (up to 32).
+ * @note Pushing more bits than reserved by `bit_writer_new` raises an error.
+ */
+void bit_writer_push(BitWriter *writer, uint64_t data, size_t n);
+
+/**
+ * @brief Writes the pending bits and updates the length of the bit array.
+ * The writer can keep pushing afterwards.
+ *
+ * @param writer Pointer to the BitWriter structure.
+ */
+void bit_writer_finish(BitWriter *writer);
+
 #endif
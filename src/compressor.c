@@ -9,6 +9,9 @@
 #include "transform.h"
 #include "rle.h"
 #include "huffman.h"
+#include "ans.h"
+#include "range.h"
+#include "histogram.h"
 #include "error.h"
 #include <stdlib.h>
 #include <string.h>
@@ -20,8 +23,13 @@ typedef enum {
     CompressionType_Circular,
 } CompressionType;
 
+#define NOF_COMPRESSION_TYPES 4
 
-BitArray prehuffman_compress(uint8_t *bytes, size_t size, bool should_transform) {
+void compress_block_forms(Image *block, bool should_transform, RleFormat format, BitArray forms[NOF_COMPRESSION_TYPES]);
+CompressionType compress_block_pick(BitArray forms[NOF_COMPRESSION_TYPES], uint8_t *lens, bool has_own_table);
+void compress_blocks(Image *image, uint16_t block_size, bool should_transform, RleFormat format, bool has_own_tables, SegmentList *output, BitArray *metadata);
+
+BitArray prehuffman_compress(uint8_t *bytes, size_t size, bool should_transform, RleFormat format) {
     BitArray tmp = bit_array_new(bytes, size);
     if (got_error()) return tmp;
 
@@ -29,14 +37,14 @@ BitArray prehuffman_compress(uint8_t *bytes, size_t size, bool should_transform)
         transform(tmp.data, size);
     }
 
-    BitArray result = rle_encode(tmp.data, size);
+    BitArray result = rle_encode_with(tmp.data, size, format, RleKernel_Auto);
     bit_array_free(&tmp);
     return result;
 }
 
-size_t posthuffman_decompress(uint8_t *bytes, size_t size, bool should_transform, Image *output) {
+size_t posthuffman_decompress(uint8_t *bytes, size_t size, bool should_transform, RleFormat format, Image *output) {
     size_t img_size = image_size(output);
-    size_t len = rle_decode(bytes, size, output->data, img_size);
+    size_t len = rle_decode_with(bytes, size, output->data, img_size, format);
 
     if (should_transform) {
         transform_revert(output->data, img_size);
@@ -45,103 +53,150 @@ size_t posthuffman_decompress(uint8_t *bytes, size_t size, bool should_transform
     return len;
 }
 
-void compress_block(Image *block, bool should_transform, BitArray *output, BitArray *metadata) {
+void compress_block_forms(Image *block, bool should_transform, RleFormat format, BitArray forms[NOF_COMPRESSION_TYPES]) {
      uint64_t size = image_size(block);
+     forms[CompressionType_None] = bit_array_new(block->data, size);
+
      uint8_t *vertical = image_serialization(block, Serialization_Vertical);
-     BitArray vertical_data = prehuffman_compress(vertical, size, should_transform);
+     forms[CompressionType_Vertical] = prehuffman_compress(vertical, size, should_transform, format);
      free(vertical);
 
+     forms[CompressionType_Horizontal] = prehuffman_compress(block->data, size, should_transform, format);
+
      uint8_t *circular = image_serialization(block, Serialization_Circular);
-     BitArray circular_data = prehuffman_compress(circular, size, should_transform);
+     forms[CompressionType_Circular] = prehuffman_compress(circular, size, should_transform, format);
      free(circular);
 
-     BitArray horizontal_data = prehuffman_compress(block->data, size, should_transform);
+     logbytes("Data", block->data, size);
+}
 
+CompressionType compress_block_pick(BitArray forms[NOF_COMPRESSION_TYPES], uint8_t *lens, bool has_own_table) {
      CompressionType type = CompressionType_None;
-     BitArray res;
-     size_t min_val = image_size(block);
+     size_t min_val = (size_t)-1;
 
-     logbytes("Data", block->data, image_size(block));
+     /// Compared by the size after the entropy coding rather than the size of the RLE output
+     for (CompressionType t = CompressionType_None; t < NOF_COMPRESSION_TYPES; t++) {
+         size_t val = huffman_segment_bit_len(forms[t].data, bit_array_byte_len(&forms[t]), lens, has_own_table);
 
-     if (vertical_data.len < min_val) {
-         min_val = vertical_data.len;
-         type = CompressionType_Vertical;
+         if (val < min_val) {
+             min_val = val;
+             type = t;
+         }
      }
 
-     if (horizontal_data.len < min_val) {
-         min_val = horizontal_data.len;
-         type = CompressionType_Horizontal;
-     }
+     logfmt("Compressed Type %d", type);
+     return type;
+}
 
-     if (circular_data.len < min_val) {
-         min_val = circular_data.len;
-         type = CompressionType_Circular;
-     }
+void compress_blocks(Image *image, uint16_t block_size, bool should_transform, RleFormat format, bool has_own_tables, SegmentList *output, BitArray *metadata) {
+    uint16_t nof_blocks = image_number_of_blocks(image, block_size);
+    BitArray (*forms)[NOF_COMPRESSION_TYPES] = calloc(nof_blocks ? nof_blocks : 1, sizeof(*forms));
+    uint64_t freq[HISTOGRAM_LEN] = {0};
+    uint8_t lens[HISTOGRAM_LEN];
+    if (!forms) {
+        set_error(Error_OutOfMemory);
+    }
 
-     switch (type) {
-         case CompressionType_None:
-             res = bit_array_new(block->data, image_size(block));
-             bit_array_free(&vertical_data);
-             bit_array_free(&horizontal_data);
-             bit_array_free(&circular_data);
-             break;
-         case CompressionType_Horizontal:
-             res = horizontal_data;
-             bit_array_free(&vertical_data);
-             bit_array_free(&circular_data);
-             break;
-         case CompressionType_Vertical:
-             res = vertical_data;
-             bit_array_free(&circular_data);
-             bit_array_free(&horizontal_data);
-             break;
-         case CompressionType_Circular:
-             res = circular_data;
-             bit_array_free(&vertical_data);
-             bit_array_free(&horizontal_data);
-             break;
-     }
+    /// The table shared by the blocks is estimated from all their forms, before any of them is picked
+    for (uint16_t i = 0; i < nof_blocks && !got_error(); i++) {
+        Image block = image_get_block(image, i, block_size);
+        compress_block_forms(&block, should_transform, format, forms[i]);
+        image_free(&block);
 
-     logfmt("Compressed Type %d", type);
-     logbytes("Compressed data", res.data, bit_array_byte_len(&res));
-     // -> write type
-     bit_array_push_n(metadata, type, 2);
-     bit_array_concat(output, &res);
-     bit_array_free(&res);
+        for (size_t t = 0; t < NOF_COMPRESSION_TYPES && !got_error(); t++) {
+            histogram_count(freq, forms[i][t].data, bit_array_byte_len(&forms[i][t]));
+        }
+    }
+
+    if (!got_error()) {
+        huffman_build_code_lens(freq, lens);
+    }
+
+    /// The form of a block is the one that codes the smallest with the table it ends up with
+    for (uint16_t i = 0; i < nof_blocks && !got_error(); i++) {
+        CompressionType type = compress_block_pick(forms[i], lens, has_own_tables);
+        logbytes("Compressed data", forms[i][type].data, bit_array_byte_len(&forms[i][type]));
+        bit_array_push_n(metadata, type, 2);
+        segment_list_push(output, &forms[i][type]);
+    }
+
+    for (uint16_t i = 0; forms && i < nof_blocks; i++) {
+        for (size_t t = 0; t < NOF_COMPRESSION_TYPES; t++) {
+            bit_array_free(&forms[i][t]);
+        }
+    }
+
+    free(forms);
 }
 
 BitArray compressor_image_compress(Image *image, Args *args) {
+    SegmentList output = segment_list_new();
     BitArray result = bit_array_new(NULL, 0);
 
-    bit_array_push_n(&result, (unsigned)image->width - 1, 16);
-    bit_array_push_n(&result, (unsigned)image->height - 1, 16);
+    compressor_image_compress_segments(image, args, &output);
+
+    if (!got_error()) {
+        result = segment_list_join(&output);
+    }
+
+    segment_list_free(&output);
+    return result;
+}
+
+void compressor_image_compress_segments(Image *image, Args *args, SegmentList *output) {
+    SegmentList input = segment_list_new();
+    BitArray header = bit_array_new(NULL, 0);
+    size_t size = image_size(image);
+    RleFormat rle_format = args->has_long_runs ? RleFormat_Long : RleFormat_Short;
+
+    bit_array_push_n(&header, (unsigned)image->width - 1, 16);
+    bit_array_push_n(&header, (unsigned)image->height - 1, 16);
+    segment_list_push(&input, &header);
+
+    /// Block tables and contexts both need the payload as a single stream
+    bool is_single_stream = args->nof_streams <= 1 && !args->chunk_size;
+    /// Every block may carry its own table, the adaptive models of the range coder follow a block much the same way
+    bool has_own_tables = (args->image_adaptive && is_single_stream && !args->is_ans) || args->is_range;
 
     if (args->image_adaptive) {
+        /// Blocks are chained after the metadata, which is only known at the end
         BitArray blocks_metadata = bit_array_new(NULL, 0);
-        BitArray blocks_data = bit_array_new(NULL, 0);
+        SegmentList blocks_data = segment_list_new();
         uint16_t nof_blocks = image_number_of_blocks(image, args->block_size);
-        for (uint16_t i = 0; i < nof_blocks; i++) {
-            Image block = image_get_block(image, i, args->block_size);
-            compress_block(&block, args->transformace_data, &blocks_data, &blocks_metadata);
-            image_free(&block);
-        }
+        bit_array_reserve(&blocks_metadata, (nof_blocks * 2 + 7) / 8);
 
+        compress_blocks(image, args->block_size, args->transformace_data, rle_format, has_own_tables, &blocks_data, &blocks_metadata);
         bit_array_pad_to_byte(&blocks_metadata);
 
-        bit_array_concat(&result, &blocks_metadata);
-        bit_array_concat(&result, &blocks_data);
-        bit_array_free(&blocks_metadata);
-        bit_array_free(&blocks_data);
+        segment_list_push(&input, &blocks_metadata);
+        segment_list_append(&input, &blocks_data);
+        segment_list_free(&blocks_data);
     } else {
-        BitArray data = prehuffman_compress(image->data, image_size(image), args->transformace_data);
-        bit_array_concat(&result, &data);
-        bit_array_free(&data);
+        BitArray data = prehuffman_compress(image->data, size, args->transformace_data, rle_format);
+        segment_list_push(&input, &data);
     }
 
-    BitArray huffman = huffman_compress(result.data, bit_array_byte_len(&result));
-    bit_array_free(&result);
+    HuffmanOptions options = {
+        .nof_streams = args->nof_streams,
+        .chunk_size = (size_t)args->chunk_size * 1024,
+        .has_block_tables = args->image_adaptive && is_single_stream,
+        .nof_tables = args->nof_tables,
+        /// The RLE tokens of the residuals of the model are coded depending on the previous byte of them
+        .nof_contexts = args->transformace_data && !args->image_adaptive && is_single_stream ? HUFFMAN_MAX_CONTEXTS : 0,
+        .has_pairs = args->has_pairs && is_single_stream,
+        /// Unlike the model and the adaptive scanning, the RLE format is stored in the data
+        .has_long_runs = args->has_long_runs,
+    };
+
+    if (!got_error() && args->is_ans) {
+        ans_compress_segments(&input, args->has_long_runs ? ANS_FLAG_LONG_RUNS : 0, output);
+    } else if (!got_error() && args->is_range) {
+        range_compress_segments(&input, args->has_long_runs ? RANGE_FLAG_LONG_RUNS : 0, output);
+    } else if (!got_error()) {
+        huffman_compress_segments(&input, &options, output);
+    }
 
-    return huffman;
+    segment_list_free(&input);
 }
 
 Image compressor_image_decompress(uint8_t *bytes, size_t len, Args *args) {
@@ -153,7 +208,21 @@ Image compressor_image_decompress(uint8_t *bytes, size_t len, Args *args) {
             return image; \
         }
 
-    BitArray bits = huffman_decompress(bytes, len);
+    /// The entropy coder is told by the leading bytes of the data, the RLE format is recorded by it
+    BitArray bits;
+    bool has_long_runs;
+    if (ans_has_magic(bytes, len)) {
+        has_long_runs = ans_flags(bytes, len) & ANS_FLAG_LONG_RUNS;
+        bits = ans_decompress(bytes, len);
+    } else if (range_has_magic(bytes, len)) {
+        has_long_runs = range_flags(bytes, len) & RANGE_FLAG_LONG_RUNS;
+        bits = range_decompress(bytes, len);
+    } else {
+        has_long_runs = huffman_has_long_runs(bytes, len);
+        bits = huffman_decompress(bytes, len);
+    }
+
+    RleFormat rle_format = has_long_runs ? RleFormat_Long : RleFormat_Short;
 
     uint16_t width  = bit_array_read_n(&bits, 16) + 1;
     uint16_t height = bit_array_read_n(&bits, 16) + 1;
@@ -201,11 +270,11 @@ Image compressor_image_decompress(uint8_t *bytes, size_t len, Args *args) {
                     break;
                 case CompressionType_Horizontal:
                     log("Compressed horizontal");
-                    len = posthuffman_decompress(data, data_len, args->transformace_data, &block);
+                    len = posthuffman_decompress(data, data_len, args->transformace_data, rle_format, &block);
                     break;
                 case CompressionType_Vertical: {
                     log("Compressed vertical");
-                    len = posthuffman_decompress(data, data_len, args->transformace_data, &block);
+                    len = posthuffman_decompress(data, data_len, args->transformace_data, rle_format, &block);
                     Image tmp = image_deserialization(block.data, block.width, block.height, Serialization_Vertical);
                     image_free(&block);
                     block = tmp;
@@ -213,7 +282,7 @@ Image compressor_image_decompress(uint8_t *bytes, size_t len, Args *args) {
                 }
                 case CompressionType_Circular:
                     log("Compressed circular");
-                    len = posthuffman_decompress(data, data_len, args->transformace_data, &block);
+                    len = posthuffman_decompress(data, data_len, args->transformace_data, rle_format, &block);
                     Image tmp = image_deserialization(block.data, block.width, block.height, Serialization_Circular);
                     image_free(&block);
                     block = tmp;
@@ -232,7 +301,7 @@ Image compressor_image_decompress(uint8_t *bytes, size_t len, Args *args) {
 
         bit_array_free(&block_metadata);
     } else {
-        posthuffman_decompress(data, data_len, args->transformace_data, &image);
+        posthuffman_decompress(data, data_len, args->transformace_data, rle_format, &image);
     }
 
     bit_array_free(&bits);
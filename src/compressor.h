@@ -11,6 +11,7 @@
 #include "bit_array.h"
 #include "args.h"
 #include "image.h"
+#include "segments.h"
 
 /**
  * @brief Compresses an image using specified encoding techniques.
@@ -25,6 +26,18 @@
  */
 BitArray compressor_image_compress(Image *image, Args *args);
 
+/**
+ * @brief Compresses an image into a chain of segments.
+ *
+ * Same as `compressor_image_compress`, but the parts of the output are kept
+ * apart so that they can be written out without joining them into one buffer.
+ *
+ * @param image Pointer to the Image structure to be compressed.
+ * @param args Pointer to the Args structure containing compression options.
+ * @param output Pointer to the list the compressed segments are appended to.
+ */
+void compressor_image_compress_segments(Image *image, Args *args, SegmentList *output);
+
 /**
  * @brief Decompresses image data into an Image structure.
  * 
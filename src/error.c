@@ -7,7 +7,8 @@
 
 #include "error.h"
 
-Error ERROR = Error_None;
+/// Every thread has its own error, see `thread_pool_run` for passing it on
+_Thread_local Error ERROR = Error_None;
 
 void set_error(Error err) {
     ERROR = err;
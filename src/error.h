@@ -42,6 +42,7 @@ typedef enum {
     Error_InvalidImageSize,
     Error_InvalidBlockSize,
     Error_InternalError,
+    Error_InvalidFormat,
 } Error;
 
 /**
@@ -0,0 +1,255 @@
+/**
+ * @file histogram.c
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Implementation for `histogram.h`
+ */
+
+#include "histogram.h"
+#include "thread_pool.h"
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HISTOGRAM_X86
+#include <immintrin.h>
+#endif
+
+/// Number of interleaved sub-histograms, consecutive bytes land in different ones
+/// so that runs of the same value do not wait for the previous increment
+#define SUB_HISTOGRAMS 4
+
+/// Bytes counted into 32-bit sub-histograms before they are flushed, keeps them from overflowing
+#define FLUSH_INTERVAL ((size_t)1 << 30)
+
+/// Smallest amount of data worth a thread of its own
+#define BYTES_PER_THREAD ((size_t)1 << 20)
+
+typedef void (*HistogramFn)(uint64_t *freq, uint8_t *bytes, size_t len);
+
+typedef struct {
+    HistogramFn kernel;
+    Segment *segment; ///< Segment the job starts in
+    size_t offset; ///< Offset of the first byte within that segment
+    size_t len; ///< Number of bytes, continuing over the following segments
+    uint64_t freq[HISTOGRAM_LEN];
+} HistogramJob;
+
+void histogram_scalar(uint64_t *freq, uint8_t *bytes, size_t len);
+void histogram_avx2(uint64_t *freq, uint8_t *bytes, size_t len);
+void histogram_flush(uint64_t *freq, uint32_t sub[][HISTOGRAM_LEN], size_t nof_sub);
+HistogramFn histogram_kernel(HistogramKernel kernel);
+void histogram_count_parts(uint64_t freq[HISTOGRAM_LEN], Segment *segments, size_t nof_segments, HistogramKernel kernel, size_t nof_threads);
+size_t histogram_nof_threads(size_t len);
+void histogram_job(void *context, size_t index);
+
+void histogram_count(uint64_t freq[HISTOGRAM_LEN], uint8_t *bytes, size_t len) {
+    histogram_count_with(freq, bytes, len, HistogramKernel_Auto, 0);
+}
+
+void histogram_count_with(uint64_t freq[HISTOGRAM_LEN], uint8_t *bytes, size_t len, HistogramKernel kernel, size_t nof_threads) {
+    Segment segment = { .data = bytes, .len = len, .is_owned = false };
+    histogram_count_parts(freq, &segment, 1, kernel, nof_threads);
+}
+
+void histogram_count_segments(uint64_t freq[HISTOGRAM_LEN], SegmentList *input) {
+    histogram_count_segments_with(freq, input, HistogramKernel_Auto, 0);
+}
+
+void histogram_count_segments_with(uint64_t freq[HISTOGRAM_LEN], SegmentList *input, HistogramKernel kernel, size_t nof_threads) {
+    histogram_count_parts(freq, input->items, input->size, kernel, nof_threads);
+}
+
+void histogram_count_parts(uint64_t freq[HISTOGRAM_LEN], Segment *segments, size_t nof_segments, HistogramKernel kernel, size_t nof_threads) {
+    HistogramFn fn = histogram_kernel(kernel);
+    size_t len = 0;
+
+    for (size_t s = 0; s < nof_segments; s++) {
+        len += segments[s].len;
+    }
+
+    if (!nof_threads) nof_threads = histogram_nof_threads(len);
+    if (nof_threads > HISTOGRAM_MAX_THREADS) nof_threads = HISTOGRAM_MAX_THREADS;
+    if (nof_threads > len) nof_threads = len;
+
+    if (nof_threads <= 1) {
+        for (size_t s = 0; s < nof_segments; s++) {
+            fn(freq, segments[s].data, segments[s].len);
+        }
+
+        return;
+    }
+
+    HistogramJob jobs[HISTOGRAM_MAX_THREADS];
+    size_t chunk = len / nof_threads;
+
+    /// The bytes are split evenly, no matter how they are spread over the segments,
+    /// so many small segments (the blocks of the adaptive mode) are counted in parallel too
+    Segment *segment = segments;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < nof_threads; i++) {
+        jobs[i].kernel = fn;
+        jobs[i].len = i + 1 == nof_threads ? len - i * chunk : chunk;
+        memset(jobs[i].freq, 0, sizeof(jobs[i].freq));
+
+        while (offset == segment->len) {
+            segment += 1;
+            offset = 0;
+        }
+
+        jobs[i].segment = segment;
+        jobs[i].offset = offset;
+
+        /// Moves to where the next job starts
+        for (size_t left = jobs[i].len; left && i + 1 < nof_threads;) {
+            size_t n = segment->len - offset < left ? segment->len - offset : left;
+            left -= n;
+            offset += n;
+
+            if (left) {
+                segment += 1;
+                offset = 0;
+            }
+        }
+    }
+
+    thread_pool_run(histogram_job, jobs, nof_threads, nof_threads);
+
+    for (size_t i = 0; i < nof_threads; i++) {
+        for (size_t j = 0; j < HISTOGRAM_LEN; j++) {
+            freq[j] += jobs[i].freq[j];
+        }
+    }
+}
+
+bool histogram_has_avx2() {
+#ifdef HISTOGRAM_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+HistogramFn histogram_kernel(HistogramKernel kernel) {
+    switch (kernel) {
+        case HistogramKernel_Scalar:
+            return histogram_scalar;
+        case HistogramKernel_Auto:
+        case HistogramKernel_Avx2:
+            break;
+    }
+
+    return histogram_has_avx2() ? histogram_avx2 : histogram_scalar;
+}
+
+size_t histogram_nof_threads(size_t len) {
+    size_t nof_cpus = thread_pool_nof_cpus();
+    size_t nof_threads = len / BYTES_PER_THREAD;
+
+    if (nof_threads > nof_cpus) nof_threads = nof_cpus;
+
+    return nof_threads;
+}
+
+void histogram_job(void *context, size_t index) {
+    HistogramJob *job = (HistogramJob *)context + index;
+    Segment *segment = job->segment;
+    size_t offset = job->offset;
+
+    for (size_t left = job->len; left; segment++, offset = 0) {
+        size_t n = segment->len - offset < left ? segment->len - offset : left;
+        job->kernel(job->freq, segment->data + offset, n);
+        left -= n;
+    }
+}
+
+void histogram_flush(uint64_t *freq, uint32_t sub[][HISTOGRAM_LEN], size_t nof_sub) {
+    for (size_t i = 0; i < nof_sub; i++) {
+        for (size_t j = 0; j < HISTOGRAM_LEN; j++) {
+            freq[j] += sub[i][j];
+        }
+
+        memset(sub[i], 0, sizeof(sub[i]));
+    }
+}
+
+void histogram_scalar(uint64_t *freq, uint8_t *bytes, size_t len) {
+    uint32_t sub[SUB_HISTOGRAMS][HISTOGRAM_LEN] = {0};
+
+    while (len) {
+        size_t n = len < FLUSH_INTERVAL ? len : FLUSH_INTERVAL;
+        size_t i = 0;
+
+        for (; i + SUB_HISTOGRAMS <= n; i += SUB_HISTOGRAMS) {
+            sub[0][bytes[i]] += 1;
+            sub[1][bytes[i + 1]] += 1;
+            sub[2][bytes[i + 2]] += 1;
+            sub[3][bytes[i + 3]] += 1;
+        }
+
+        for (; i < n; i++) {
+            sub[0][bytes[i]] += 1;
+        }
+
+        histogram_flush(freq, sub, SUB_HISTOGRAMS);
+        bytes += n;
+        len -= n;
+    }
+}
+
+#ifdef HISTOGRAM_X86
+
+/// Counts 32 bytes at a time, a vector made of a single value (a run) is counted
+/// with one addition, the others are spread over the sub-histograms from 64-bit lanes
+__attribute__((target("avx2")))
+void histogram_avx2(uint64_t *freq, uint8_t *bytes, size_t len) {
+    uint32_t sub[SUB_HISTOGRAMS][HISTOGRAM_LEN] = {0};
+
+    while (len) {
+        size_t n = len < FLUSH_INTERVAL ? len : FLUSH_INTERVAL;
+        size_t i = 0;
+
+        for (; i + 32 <= n; i += 32) {
+            __m256i data = _mm256_loadu_si256((const __m256i *)(bytes + i));
+            __m256i first = _mm256_set1_epi8((char)bytes[i]);
+
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, first)) == -1) {
+                sub[0][bytes[i]] += 32;
+                continue;
+            }
+
+            uint64_t words[4];
+            _mm256_storeu_si256((__m256i *)words, data);
+
+            for (int lane = 0; lane < 4; lane++) {
+                uint64_t word = words[lane];
+                sub[0][word & 0xFF] += 1;
+                sub[1][(word >> 8) & 0xFF] += 1;
+                sub[2][(word >> 16) & 0xFF] += 1;
+                sub[3][(word >> 24) & 0xFF] += 1;
+                sub[0][(word >> 32) & 0xFF] += 1;
+                sub[1][(word >> 40) & 0xFF] += 1;
+                sub[2][(word >> 48) & 0xFF] += 1;
+                sub[3][word >> 56] += 1;
+            }
+        }
+
+        for (; i < n; i++) {
+            sub[0][bytes[i]] += 1;
+        }
+
+        histogram_flush(freq, sub, SUB_HISTOGRAMS);
+        bytes += n;
+        len -= n;
+    }
+}
+
+#else
+
+void histogram_avx2(uint64_t *freq, uint8_t *bytes, size_t len) {
+    histogram_scalar(freq, bytes, len);
+}
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @file histogram.h
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Byte histogram kernels
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "segments.h"
+
+/// Number of distinct byte values
+#define HISTOGRAM_LEN 256
+
+/// Most worker threads a single count is split across
+#define HISTOGRAM_MAX_THREADS 16
+
+/**
+ * @brief Enumeration of the counting kernels.
+ */
+typedef enum {
+    HistogramKernel_Auto, /**< Best kernel supported by the running CPU */
+    HistogramKernel_Scalar, /**< Portable kernel with interleaved sub-histograms */
+    HistogramKernel_Avx2, /**< AVX2 kernel, falls back to scalar when not supported */
+} HistogramKernel;
+
+/**
+ * @brief Adds the number of occurrences of every byte value to the histogram.
+ *
+ * Large inputs are split across worker threads.
+ *
+ * @param freq Histogram to be added to.
+ * @param bytes Pointer to the data.
+ * @param len Length of the data.
+ */
+void histogram_count(uint64_t freq[HISTOGRAM_LEN], uint8_t *bytes, size_t len);
+
+/**
+ * @brief Same as `histogram_count` with an explicit kernel and number of threads.
+ *
+ * @param freq Histogram to be added to.
+ * @param bytes Pointer to the data.
+ * @param len Length of the data.
+ * @param kernel Counting kernel to be used.
+ * @param nof_threads Number of threads, 0 to decide based on the input size and CPU count.
+ */
+void histogram_count_with(uint64_t freq[HISTOGRAM_LEN], uint8_t *bytes, size_t len, HistogramKernel kernel, size_t nof_threads);
+
+/**
+ * @brief Adds the number of occurrences of every byte value of all the segments to the histogram.
+ *
+ * The segments are counted as one input, so even a list of many small segments is split across worker threads.
+ *
+ * @param freq Histogram to be added to.
+ * @param input Pointer to the segments of the data.
+ */
+void histogram_count_segments(uint64_t freq[HISTOGRAM_LEN], SegmentList *input);
+
+/**
+ * @brief Same as `histogram_count_segments` with an explicit kernel and number of threads.
+ *
+ * @param freq Histogram to be added to.
+ * @param input Pointer to the segments of the data.
+ * @param kernel Counting kernel to be used.
+ * @param nof_threads Number of threads, 0 to decide based on the input size and CPU count.
+ */
+void histogram_count_segments_with(uint64_t freq[HISTOGRAM_LEN], SegmentList *input, HistogramKernel kernel, size_t nof_threads);
+
+/**
+ * @brief Checks whether the running CPU supports the AVX2 kernel.
+ *
+ * @return true if the AVX2 kernel is available.
+ */
+bool histogram_has_avx2();
+
+#endif
@@ -6,15 +6,82 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
 #include "error.h"
 #include "bit_array.h"
 #include "huffman.h"
+#include "histogram.h"
+#include "thread_pool.h"
 #include <string.h>
 
 /// 256 + EOF
 #define ALPHABET_LEN 257
 #define EOF_BYTE (ALPHABET_LEN - 1)
-#define HUFFMAN_NULL_VAL (ALPHABET_LEN)
+
+/// Number of bits resolved by the primary decode table
+#define DECODE_TABLE_BITS 11
+#define DECODE_TABLE_SIZE (1 << DECODE_TABLE_BITS)
+/// Number of bits resolved by each overflow sub-table
+#define DECODE_SUBTABLE_BITS 5
+#define DECODE_SUBTABLE_SIZE (1 << DECODE_SUBTABLE_BITS)
+/// Maximum number of symbols emitted by a single multi-symbol table probe
+#define MULTI_DECODE_MAX_SYMBOLS 4
+
+/// Leading bytes of the extended formats. A legacy stream never starts with them, that would
+/// describe 256 symbols where the first (shortest) code, of character 0xFF, is 256 bits long.
+#define HUFFMAN_MAGIC 0xFFFFFF
+/// Leading bytes of a stream whose payload is run-length encoded with runs of any length, the stream
+/// itself follows. A legacy stream never starts with them, the first code would be 253 bits long.
+#define HUFFMAN_LONG_RUNS_MAGIC 0xFCFFFF
+/// The payload is split into interleaved streams sharing one codebook
+#define HUFFMAN_FLAG_STREAMS (1 << 0)
+/// The payload is split into independently decodable chunks with an offset index
+#define HUFFMAN_FLAG_CHUNKS (1 << 1)
+/// The code lengths are stored in the compact form of `symbols_encode_compact`
+#define HUFFMAN_FLAG_COMPACT_TABLE (1 << 2)
+/// The decoded length is stored in the header and the alphabet is the plain 256 bytes, without EOF
+#define HUFFMAN_FLAG_LENGTH (1 << 3)
+/// The segments of the input are grouped into runs, each coded with the shared table or its own one
+#define HUFFMAN_FLAG_BLOCK_TABLES (1 << 4)
+/// The block tables are clustered into several tables stored up front, every run refers to one of them
+#define HUFFMAN_FLAG_TABLE_MAP (1 << 5)
+/// Every byte is coded with one of several tables, selected by the magnitude of the previous byte
+#define HUFFMAN_FLAG_CONTEXTS (1 << 6)
+/// Pairs of bytes are coded as single symbols through a dictionary of pairs
+#define HUFFMAN_FLAG_PAIRS (1 << 7)
+
+/// Number of all possible pairs of bytes
+#define PAIR_ALPHABET_LEN (1 << 16)
+
+/// Bits of the width of the length of a run of the block tables, the length follows in that many bits
+#define RUN_LEN_WIDTH_BITS 6
+/// Upper bound of the k-means rounds between two changes of the number of clusters
+#define CLUSTER_MAX_ITERATIONS 16
+/// Upper bound of the rounds of dropping the unprofitable tables and refining the rest
+#define CLUSTER_MAX_ROUNDS 8
+
+/// Code-length alphabet of the compact table, literal lengths 0 (absent) to 32 and three repeat codes
+#define CL_REPEAT (HUFFMAN_MAX_CODE_LEN + 1) ///< Previous length 3-6 times, 2 extra bits
+#define CL_ZEROS (HUFFMAN_MAX_CODE_LEN + 2) ///< 3-10 absent symbols, 3 extra bits
+#define CL_ZEROS_LONG (HUFFMAN_MAX_CODE_LEN + 3) ///< 11-138 absent symbols, 7 extra bits
+#define CL_ALPHABET_LEN (HUFFMAN_MAX_CODE_LEN + 4)
+/// Code lengths of the code-length alphabet are stored in 3 bits
+#define CL_MAX_CODE_LEN 7
+
+/// Smallest amount of input worth a thread of its own in the encoder
+#define PARALLEL_ENCODE_MIN_BYTES (1 << 20)
+/// Smallest amount of coded data worth a speculative decoder of its own
+#define SPECULATIVE_MIN_BYTES (64 * 1024)
+/// Least number of speculative decoders when the mode is requested explicitly
+#define SPECULATIVE_MIN_PARTS 4
+/// Coded data from which the speculative decoder is picked automatically on a multi-core machine
+#define SPECULATIVE_AUTO_MIN_BYTES (1 << 20)
+/// Code boundaries remembered at the start of every speculative part, the decoders
+/// of neighbouring parts synchronize within a few dozen codes, or a few
+/// hundred for nearly fixed-length codes
+#define SPECULATIVE_BOUNDARIES 8192
+/// EOF codes a speculative part may run into, all but the real one come from decoding garbage
+#define SPECULATIVE_MAX_EOFS 64
 
 typedef uint64_t Frequency;
 
@@ -36,137 +103,2420 @@ typedef struct {
     size_t size;
 } Symbols;
 
-typedef struct {
-    Frequency frequency;
-    size_t m;
-} Node;
+typedef struct {
+    Frequency frequency;
+    size_t m;
+} Node;
+
+typedef struct {
+    Node data[ALPHABET_LEN]; ///< No need for dynamic allocation here since maximum number of node will always be the alphabet length.
+    size_t size;
+} AlphabetMinHeap;
+
+/// Marks a package (pair of cheaper items) in the package-merge lists
+#define PACKAGE_ITEM ALPHABET_LEN
+
+typedef struct {
+    Frequency weight;
+    uint16_t symbol; ///< Index into `Symbols`, or `PACKAGE_ITEM`
+} PackageItem;
+
+typedef struct {
+    uint16_t value; ///< Decoded symbol, or index of the linked sub-table when `link` is set
+    uint8_t len; ///< Number of bits consumed by this entry, 0 for a prefix without any code
+    uint8_t link; ///< Whether this entry points to a sub-table
+} DecodeEntry;
+
+/// Primary table of `DECODE_TABLE_SIZE` entries followed by the sub-tables of `DECODE_SUBTABLE_SIZE` entries,
+/// indexed by the upcoming bits of the stream. Allocated at once for the whole alphabet.
+typedef struct {
+    DecodeEntry *entries;
+    size_t nof_subtables;
+    bool has_eof; ///< Whether the data is terminated by EOF, otherwise its length is known beforehand
+} DecodeTable;
+
+typedef struct {
+    uint8_t symbols[MULTI_DECODE_MAX_SYMBOLS]; ///< Decoded bytes in stream order
+    uint8_t count; ///< Number of whole symbols, 0 when the first code does not fit into the table
+    uint8_t len; ///< Total number of bits consumed by all the symbols
+} MultiDecodeEntry;
+
+/// Indexed by the same bits as the primary table of `DecodeTable`.
+typedef MultiDecodeEntry MultiDecodeTable[DECODE_TABLE_SIZE];
+
+/// Part of the input coded by one thread of the parallel encoder
+typedef struct {
+    size_t segment; ///< Segment the part starts in
+    size_t offset; ///< Offset of the first byte within the segment
+    size_t len; ///< Number of input bytes
+    size_t nof_bits; ///< Number of coded bits
+    size_t start; ///< Bit position of the first code in the output
+    BitWriter writer; ///< State after the part, its last partial word is not stored yet
+} EncodePart;
+
+/// Shared state of the workers of the parallel encoder
+typedef struct {
+    SegmentList *input;
+    Code *codebook;
+    Code *reversed;
+    EncodePart *parts;
+    BitArray *output;
+} PartEncoder;
+
+/// Part of a single stream decoded from a guessed starting position
+typedef struct {
+    BitReader reader; ///< Kept between the passes
+    size_t end; ///< Bit position where the next part starts
+    BitArray output; ///< Decoded symbols, including the ones past `end` up to the synchronization
+    size_t boundaries[SPECULATIVE_BOUNDARIES]; ///< Bit positions of the first decoded symbols
+    size_t nof_boundaries;
+    size_t eofs[SPECULATIVE_MAX_EOFS]; ///< Indices of the decoded EOF codes, a zero byte stands in for them in the output
+    size_t nof_eofs;
+    size_t sync; ///< Index of the first symbol of the next part which continues this one
+    bool is_done; ///< Decoding stopped at an EOF that is certainly not garbage
+    bool is_failed; ///< Decoding went wrong or did not synchronize
+} SpeculativePart;
+
+/// Shared state of the speculative decoders
+typedef struct {
+    DecodeTable *table;
+    SpeculativePart *parts;
+    size_t nof_parts;
+    size_t len; ///< Decoded length, only used when the data is not terminated by EOF
+} SpeculativeDecoder;
+
+/// Consecutive segments of the input coded with the same table
+typedef struct {
+    size_t segment; ///< First segment of the run
+    size_t nof_segments;
+    size_t len; ///< Number of input bytes
+    bool is_own; ///< Whether the run carries its own table, otherwise the shared one is used
+    size_t table; ///< Index of the table in the table map
+} BlockRun;
+
+/// Symbols present in a segment with their counts, the input of the table clustering
+typedef struct {
+    uint8_t symbols[HISTOGRAM_LEN];
+    Frequency counts[HISTOGRAM_LEN];
+    size_t size;
+} SparseHistogram;
+
+/// Pairs of bytes with their own symbol, the symbol after the last pair is the escape followed by a raw pair
+typedef struct {
+    uint8_t pairs[HISTOGRAM_LEN][2];
+    size_t size;
+    bool has_escape;
+    Frequency nof_escapes; ///< Number of pairs coded through the escape, only known to the encoder
+} PairDictionary;
+
+/// Pair of bytes, first byte in the low bits, with its number of occurrences
+typedef struct {
+    Frequency frequency;
+    uint16_t pair;
+} PairCount;
+
+/// Shared state of the workers decoding chunks
+typedef struct {
+    DecodeTable *table;
+    MultiDecodeEntry *multi; ///< NULL when the multi-symbol table is not used
+    BitReader *reader; ///< Reader of the whole input
+    size_t base; ///< Byte offset of the first chunk
+    size_t *offsets; ///< Byte offsets of the chunks relative to `base`, plus the end of the last one
+    size_t nof_streams;
+    size_t chunk_size;
+    size_t len; ///< Decoded length of all chunks
+    uint8_t *output;
+} ChunkDecoder;
+
+void symbols_from_segments(Symbols *symbols, SegmentList *input, bool has_eof);
+void symbols_from_frequencies(Symbols *symbols, Frequency freq[ALPHABET_LEN]);
+void symbols_build_code_len(Symbols *symbols, size_t max_code_len);
+size_t symbols_compact_bit_len(Symbols *symbols);
+void symbols_push(Symbols *symbols, Symbol symbol);
+void symbols_to_codebook(Symbols *symbols, CodeBook codebook);
+size_t symbols_encoded_bit_len(Symbols *symbols);
+void codebook_reverse(CodeBook codebook, CodeBook reversed);
+void symbols_calc_code(Symbols *symbols);
+void symbols_calc_code_len(Symbols *symbols);
+void symbols_calc_code_len_limited(Symbols *symbols, size_t max_len);
+size_t symbols_max_code_len(Symbols *symbols);
+void symbols_sort(Symbols *symbols);
+void symbols_encode(Symbols *symbols, bool has_eof, BitArray *output);
+void symbols_decode(Symbols *symbols, bool has_eof, BitArray *input);
+void symbols_encode_compact(Symbols *symbols, BitArray *output);
+void symbols_decode_compact(Symbols *symbols, bool has_eof, BitArray *input);
+size_t symbols_run_len(uint8_t *lens, size_t i, size_t max);
+
+void alphabet_min_heap_push(AlphabetMinHeap *heap, Frequency freq, size_t m);
+Node alphabet_min_heap_pop(AlphabetMinHeap *heap);
+
+void decode_table_build(DecodeTable *table, Symbols *symbols);
+void decode_table_free(DecodeTable *table);
+void decode_table_fill(DecodeEntry *entries, size_t table_bits, uint64_t code, uint8_t len, uint16_t value);
+uint16_t decode_table_read_next(DecodeTable *table, BitReader *reader);
+void multi_decode_table_build(MultiDecodeTable multi, DecodeTable *table);
+bool multi_decode_is_worth(Symbols *symbols);
+
+uint64_t reverse_bits(uint64_t value, size_t len);
+
+bool huffman_has_magic(uint8_t *bytes, size_t len);
+void huffman_encode(SegmentList *input, CodeBook codebook, size_t nof_bits, size_t nof_threads, BitArray *output);
+void huffman_encode_parallel(SegmentList *input, CodeBook codebook, size_t nof_bits, size_t nof_parts, BitArray *output);
+void huffman_encode_part_len(void *context, size_t index);
+void huffman_encode_part(void *context, size_t index);
+size_t huffman_encode_nof_threads(SegmentList *input, size_t nof_threads);
+void huffman_encode_streams(SegmentList *input, CodeBook codebook, size_t nof_streams, BitArray *header, SegmentList *output);
+void huffman_decode_single(DecodeTable *table, BitReader *reader, BitArray *output);
+void huffman_decode_multi(DecodeTable *table, BitReader *reader, BitArray *output);
+void huffman_decode_serial(DecodeTable *table, BitReader *reader, HuffmanDecodeMode mode, size_t len, BitArray *output);
+void huffman_decode_streams(DecodeTable *table, BitArray *input, size_t nof_streams, size_t len, BitArray *output);
+size_t huffman_encoded_bit_len(SegmentList *input, CodeBook codebook);
+void huffman_encode_payload(SegmentList *input, CodeBook codebook, size_t nof_streams, SegmentList *output);
+void huffman_encode_chunks(SegmentList *input, CodeBook codebook, size_t nof_streams, size_t chunk_size, BitArray *header, SegmentList *output);
+void huffman_decode_chunks(DecodeTable *table, BitArray *input, HuffmanDecodeMode mode, size_t nof_streams, size_t chunk_size, size_t len, BitArray *output);
+void huffman_decode_chunk(void *context, size_t index);
+void huffman_decode_exact(DecodeTable *table, MultiDecodeEntry *multi, BitReader *reader, uint8_t *output, size_t len);
+void huffman_decode_streams_exact(DecodeTable *table, BitReader *reader, size_t nof_streams, uint8_t *output, size_t len);
+void huffman_decode_interleaved(DecodeTable *table, BitReader *streams, size_t nof_streams, uint8_t *output, size_t len);
+void huffman_expect_eof(DecodeTable *table, BitReader *reader);
+void huffman_decode_speculative(DecodeTable *table, BitReader *reader, size_t len, BitArray *output);
+void huffman_plan_block_tables(SegmentList *input, size_t max_code_len, Symbols *shared, BlockRun **runs, size_t *nof_runs);
+void huffman_cluster_block_tables(SegmentList *input, size_t max_code_len, size_t max_tables, Symbols **tables, size_t *nof_tables, BlockRun **runs, size_t *nof_runs);
+void huffman_encode_block_tables(SegmentList *input, CodeBook codebook, Symbols *tables, size_t nof_tables, BlockRun *runs, size_t nof_runs, size_t max_code_len, size_t nof_threads, BitArray *output);
+void huffman_decode_block_tables(DecodeTable *table, BitArray *input, HuffmanDecodeMode mode, bool has_table_map, size_t len, BitArray *output);
+void clusters_refine(SparseHistogram *histograms, size_t n, Frequency (*centers)[ALPHABET_LEN], uint8_t (*lens)[ALPHABET_LEN], size_t *k, size_t max_code_len, size_t *assignment);
+size_t clusters_segment_bits(SparseHistogram *histogram, uint8_t (*lens)[ALPHABET_LEN], size_t k, size_t max_code_len, size_t *best);
+void clusters_build_lens(Frequency histogram[ALPHABET_LEN], size_t max_code_len, uint8_t lens[ALPHABET_LEN]);
+size_t run_len_bits(size_t len);
+size_t table_index_bits(size_t nof_tables);
+void huffman_plan_contexts(SegmentList *input, size_t max_code_len, size_t max_contexts, Symbols **tables, size_t *nof_contexts);
+size_t contexts_build(Frequency (*freq)[ALPHABET_LEN], size_t nof_contexts, size_t max_code_len, Symbols *tables);
+void contexts_map(uint8_t contexts[HISTOGRAM_LEN], size_t nof_contexts);
+void huffman_encode_contexts(SegmentList *input, Symbols *tables, size_t nof_contexts, BitArray *output);
+void huffman_decode_contexts(DecodeTable *table, BitArray *input, size_t len, BitArray *output);
+void huffman_compress_pairs_or_tables(SegmentList *input, HuffmanOptions *options, SegmentList *output);
+void huffman_plan_pairs(SegmentList *input, size_t max_code_len, Symbols *symbols, PairDictionary *dictionary);
+int pairs_compare(const void *a, const void *b);
+size_t pairs_raw_bit_len(PairDictionary *dictionary, size_t len);
+void huffman_encode_pairs(SegmentList *input, CodeBook codebook, PairDictionary *dictionary, size_t nof_bits, BitArray *output);
+void huffman_decode_pairs(DecodeTable *table, BitArray *input, HuffmanDecodeMode mode, size_t len, BitArray *output);
+void pairs_multi_decode_table_build(MultiDecodeTable multi, DecodeTable *table, PairDictionary *dictionary);
+void clusters_update(SparseHistogram *histograms, size_t n, Frequency (*centers)[ALPHABET_LEN], uint8_t (*lens)[ALPHABET_LEN], size_t *k, size_t max_code_len, size_t *assignment);
+void huffman_decode_speculative_part(void *context, size_t index);
+void huffman_decode_speculative_sync(void *context, size_t index);
+bool huffman_decode_speculative_join(SpeculativeDecoder *decoder, BitArray *output);
+
+BitArray huffman_compress(uint8_t *bytes, size_t len) {
+    HuffmanOptions options = { .nof_streams = 1 };
+    return huffman_compress_with_options(bytes, len, &options);
+}
+
+BitArray huffman_compress_with_options(uint8_t *bytes, size_t len, HuffmanOptions *options) {
+    SegmentList input = segment_list_new();
+    SegmentList output = segment_list_new();
+    BitArray result = bit_array_new(NULL, 0);
+
+    segment_list_push_bytes(&input, bytes, len);
+    if (!got_error()) {
+        huffman_compress_segments(&input, options, &output);
+    }
+
+    if (!got_error()) {
+        result = segment_list_join(&output);
+    }
+
+    segment_list_free(&input);
+    segment_list_free(&output);
+
+    return result;
+}
+
+void huffman_compress_segments(SegmentList *input, HuffmanOptions *options, SegmentList *output) {
+    #define COMPRESS_ERROR_GUARD(func) func; \
+        if ( got_error()) { \
+            bit_array_free(&result); \
+            free(runs); \
+            free(tables); \
+            return; \
+        }
+
+    BitArray result = bit_array_new(NULL, 0);
+    BlockRun *runs = NULL;
+    size_t nof_runs = 0;
+    Symbols *tables = NULL;
+    size_t nof_tables = 0;
+    size_t nof_contexts = 0;
+    PairDictionary dictionary = {0};
+    size_t nof_streams = options->nof_streams ? options->nof_streams : 1;
+    size_t max_code_len = options->max_code_len ? options->max_code_len : HUFFMAN_DEFAULT_CODE_LEN;
+
+    if (max_code_len > HUFFMAN_MAX_CODE_LEN) {
+        fprintf(stderr, "ERR huffman_compress: Code length cannot exceed %d bits\n", HUFFMAN_MAX_CODE_LEN);
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (nof_streams > HUFFMAN_MAX_STREAMS) {
+        fprintf(stderr, "ERR huffman_compress: At most %d streams are supported\n", HUFFMAN_MAX_STREAMS);
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->chunk_size > HUFFMAN_MAX_CHUNK_SIZE) {
+        fprintf(stderr, "ERR huffman_compress: Chunk size cannot exceed %u bytes\n", HUFFMAN_MAX_CHUNK_SIZE);
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->nof_tables > HUFFMAN_MAX_TABLES) {
+        fprintf(stderr, "ERR huffman_compress: At most %d tables are supported\n", HUFFMAN_MAX_TABLES);
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->has_block_tables && (nof_streams > 1 || options->chunk_size || options->is_eof_symbol)) {
+        fprintf(stderr, "ERR huffman_compress: Block tables cannot be combined with streams, chunks or EOF\n");
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->nof_contexts > HUFFMAN_MAX_CONTEXTS) {
+        fprintf(stderr, "ERR huffman_compress: At most %d contexts are supported\n", HUFFMAN_MAX_CONTEXTS);
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->nof_contexts > 1 && (nof_streams > 1 || options->chunk_size || options->is_eof_symbol || options->has_block_tables)) {
+        fprintf(stderr, "ERR huffman_compress: Contexts cannot be combined with streams, chunks, EOF or block tables\n");
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->has_pairs && (nof_streams > 1 || options->chunk_size || options->is_eof_symbol)) {
+        fprintf(stderr, "ERR huffman_compress: Pairs cannot be combined with streams, chunks or EOF\n");
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (options->has_pairs && (options->has_block_tables || options->nof_contexts > 1)) {
+        huffman_compress_pairs_or_tables(input, options, output);
+        return;
+    }
+
+    log("Creating list of symbols");
+    Symbols symbols;
+    if (options->has_block_tables && options->nof_tables) {
+        /// The first cluster is stored as the shared table
+        COMPRESS_ERROR_GUARD(huffman_cluster_block_tables(input, max_code_len, options->nof_tables, &tables, &nof_tables, &runs, &nof_runs));
+        symbols = tables[0];
+    } else if (options->has_block_tables) {
+        /// The shared table only covers the runs without their own one
+        COMPRESS_ERROR_GUARD(huffman_plan_block_tables(input, max_code_len, &symbols, &runs, &nof_runs));
+    } else if (options->nof_contexts > 1) {
+        /// The first context is stored as the shared table, unless a single table is smaller
+        COMPRESS_ERROR_GUARD(huffman_plan_contexts(input, max_code_len, options->nof_contexts, &tables, &nof_contexts));
+    } else if (options->has_pairs) {
+        /// The symbols are the indices into the dictionary, unless single bytes are smaller
+        COMPRESS_ERROR_GUARD(huffman_plan_pairs(input, max_code_len, &symbols, &dictionary));
+    }
+
+    if (nof_contexts) {
+        symbols = tables[0];
+    } else if (!options->has_block_tables && !options->has_pairs) {
+        symbols_from_segments(&symbols, input, options->is_eof_symbol);
+    }
+
+    log("Calculate code len of symbols");
+    COMPRESS_ERROR_GUARD(symbols_build_code_len(&symbols, max_code_len));
+
+    log("Make codebook out of symbols");
+    /// Code book
+    CodeBook codebook;
+    symbols_to_codebook(&symbols, codebook);
+
+    uint8_t flags = 0;
+    if (nof_streams > 1) flags |= HUFFMAN_FLAG_STREAMS;
+    if (options->chunk_size) flags |= HUFFMAN_FLAG_CHUNKS;
+    if (!options->is_eof_symbol) flags |= HUFFMAN_FLAG_LENGTH;
+    if (options->has_block_tables) flags |= HUFFMAN_FLAG_BLOCK_TABLES;
+    if (nof_tables) flags |= HUFFMAN_FLAG_TABLE_MAP;
+    if (nof_contexts) flags |= HUFFMAN_FLAG_CONTEXTS;
+    if (dictionary.size) flags |= HUFFMAN_FLAG_PAIRS;
+
+    /// The compact table is used when it pays off, including the magic when the legacy format could be kept
+    COMPRESS_ERROR_GUARD(size_t compact_bits = symbols_compact_bit_len(&symbols) + (flags ? 0 : 32));
+    size_t legacy_bits = 16 * symbols.size;
+
+    /// The legacy table cannot describe EOF alone, nor an empty alphabet
+    if (symbols.size < 2 || (!options->is_legacy_table && compact_bits < legacy_bits)) {
+        flags |= HUFFMAN_FLAG_COMPACT_TABLE;
+    }
+
+    if (options->has_long_runs) {
+        COMPRESS_ERROR_GUARD(bit_array_push_n(&result, HUFFMAN_LONG_RUNS_MAGIC, 24));
+    }
+
+    /// The legacy format is kept whenever no extension is in use
+    if (flags) {
+        log("Encoding extended format header");
+        COMPRESS_ERROR_GUARD(bit_array_push_n(&result, HUFFMAN_MAGIC, 24));
+        COMPRESS_ERROR_GUARD(bit_array_push_n(&result, flags, 8));
+    }
+
+    if (flags & HUFFMAN_FLAG_STREAMS) {
+        COMPRESS_ERROR_GUARD(bit_array_push_n(&result, nof_streams - 1, 8));
+    }
+
+    if (flags & HUFFMAN_FLAG_CHUNKS) {
+        COMPRESS_ERROR_GUARD(bit_array_push_n(&result, options->chunk_size, 32));
+    }
+
+    /// The decoded length is shared by the chunk index and the alphabet without EOF
+    if (flags & (HUFFMAN_FLAG_CHUNKS | HUFFMAN_FLAG_LENGTH)) {
+        COMPRESS_ERROR_GUARD(bit_array_push_n(&result, segment_list_byte_len(input), 64));
+    }
+
+    log("Encoding codebook into the output");
+    if (flags & HUFFMAN_FLAG_COMPACT_TABLE) {
+        COMPRESS_ERROR_GUARD(symbols_encode_compact(&symbols, &result));
+    } else {
+        COMPRESS_ERROR_GUARD(symbols_encode(&symbols, options->is_eof_symbol, &result));
+    }
+
+    log("Encoding the huffman coding into the output");
+    if (flags & HUFFMAN_FLAG_BLOCK_TABLES) {
+        COMPRESS_ERROR_GUARD(huffman_encode_block_tables(input, codebook, tables, nof_tables, runs, nof_runs, max_code_len, options->nof_threads, &result));
+        segment_list_push(output, &result);
+    } else if (flags & HUFFMAN_FLAG_CONTEXTS) {
+        COMPRESS_ERROR_GUARD(huffman_encode_contexts(input, tables, nof_contexts, &result));
+        segment_list_push(output, &result);
+    } else if (flags & HUFFMAN_FLAG_PAIRS) {
+        size_t nof_bits = symbols_encoded_bit_len(&symbols) + pairs_raw_bit_len(&dictionary, segment_list_byte_len(input));
+        COMPRESS_ERROR_GUARD(huffman_encode_pairs(input, codebook, &dictionary, nof_bits, &result));
+        segment_list_push(output, &result);
+    } else if (flags & HUFFMAN_FLAG_CHUNKS) {
+        COMPRESS_ERROR_GUARD(huffman_encode_chunks(input, codebook, nof_streams, options->chunk_size, &result, output));
+    } else if (nof_streams > 1) {
+        COMPRESS_ERROR_GUARD(huffman_encode_streams(input, codebook, nof_streams, &result, output));
+    } else {
+        size_t nof_threads = huffman_encode_nof_threads(input, options->nof_threads);
+        COMPRESS_ERROR_GUARD(huffman_encode(input, codebook, symbols_encoded_bit_len(&symbols), nof_threads, &result));
+        segment_list_push(output, &result);
+    }
+
+    free(runs);
+    free(tables);
+    logfmt("Compressed to %ld bytes", segment_list_byte_len(output));
+}
+
+void huffman_compress_pairs_or_tables(SegmentList *input, HuffmanOptions *options, SegmentList *output) {
+    /// Pairs replace the whole table layout, so both are compressed and the smaller one is kept
+    HuffmanOptions pairs_options = *options;
+    pairs_options.has_block_tables = false;
+    pairs_options.nof_tables = 0;
+    pairs_options.nof_contexts = 0;
+
+    HuffmanOptions tables_options = *options;
+    tables_options.has_pairs = false;
+
+    SegmentList pairs_output = segment_list_new();
+    SegmentList tables_output = segment_list_new();
+
+    huffman_compress_segments(input, &pairs_options, &pairs_output);
+    if (!got_error()) {
+        huffman_compress_segments(input, &tables_options, &tables_output);
+    }
+
+    if (!got_error() && segment_list_byte_len(&pairs_output) < segment_list_byte_len(&tables_output)) {
+        segment_list_append(output, &pairs_output);
+    } else if (!got_error()) {
+        segment_list_append(output, &tables_output);
+    }
+
+    segment_list_free(&pairs_output);
+    segment_list_free(&tables_output);
+}
+
+void huffman_build_code_lens(uint64_t freq[HISTOGRAM_LEN], uint8_t lens[HISTOGRAM_LEN]) {
+    Frequency histogram[ALPHABET_LEN] = {0};
+    uint8_t all_lens[ALPHABET_LEN];
+
+    memcpy(histogram, freq, HISTOGRAM_LEN * sizeof(Frequency));
+    clusters_build_lens(histogram, HUFFMAN_DEFAULT_CODE_LEN, all_lens);
+    memcpy(lens, all_lens, HISTOGRAM_LEN);
+}
+
+size_t huffman_segment_bit_len(uint8_t *bytes, size_t len, uint8_t lens[HISTOGRAM_LEN], bool has_own_table) {
+    Frequency freq[ALPHABET_LEN] = {0};
+    size_t bits = 0;
+
+    histogram_count(freq, bytes, len);
+
+    for (size_t c = 0; c < HISTOGRAM_LEN; c++) {
+        bits += freq[c] * (lens[c] ? lens[c] : HUFFMAN_DEFAULT_CODE_LEN);
+    }
+
+    if (has_own_table) {
+        Symbols own;
+        symbols_from_frequencies(&own, freq);
+        symbols_build_code_len(&own, HUFFMAN_DEFAULT_CODE_LEN);
+        if (got_error()) return bits;
+
+        size_t own_bits = symbols_encoded_bit_len(&own) + symbols_compact_bit_len(&own);
+        bits = own_bits < bits ? own_bits : bits;
+    }
+
+    return bits;
+}
+
+BitArray huffman_decompress(uint8_t *bytes, size_t len) {
+    return huffman_decompress_with_mode(bytes, len, HuffmanDecodeMode_Auto);
+}
+
+BitArray huffman_decompress_with_mode(uint8_t *bytes, size_t len, HuffmanDecodeMode mode) {
+    #define DECOMPRESS_ERROR_GUARD(on_error) \
+        if ( got_error()) { \
+            on_error; \
+            bit_array_free(&input); \
+            bit_array_free(&result); \
+            return result; \
+        }
+
+    /// The format of the payload is up to the caller, only the stream follows
+    if (huffman_has_long_runs(bytes, len)) {
+        bytes += 3;
+        len -= 3;
+    }
+
+    BitArray input = bit_array_new(bytes, len);
+    BitArray result = bit_array_new(NULL, 0);
+    DECOMPRESS_ERROR_GUARD();
+
+    uint8_t flags = 0;
+    size_t nof_streams = 1;
+    size_t chunk_size = 0;
+    size_t decoded_len = 0;
+
+    if (huffman_has_magic(bytes, len)) {
+        log("Decoding extended format header");
+        input.cursor += 24;
+        flags = bit_array_read_n(&input, 8);
+        DECOMPRESS_ERROR_GUARD();
+    }
+
+    if (flags & ~(HUFFMAN_FLAG_STREAMS | HUFFMAN_FLAG_CHUNKS | HUFFMAN_FLAG_COMPACT_TABLE | HUFFMAN_FLAG_LENGTH | HUFFMAN_FLAG_BLOCK_TABLES | HUFFMAN_FLAG_TABLE_MAP | HUFFMAN_FLAG_CONTEXTS | HUFFMAN_FLAG_PAIRS)) {
+        fprintf(stderr, "ERR huffman_decompress: Unknown format flags 0x%02X\n", flags);
+        set_error(Error_InvalidFormat);
+        DECOMPRESS_ERROR_GUARD();
+    }
+
+    bool is_block_tables = flags & HUFFMAN_FLAG_BLOCK_TABLES;
+    bool has_table_map = flags & HUFFMAN_FLAG_TABLE_MAP;
+    bool has_contexts = flags & HUFFMAN_FLAG_CONTEXTS;
+    bool has_pairs = flags & HUFFMAN_FLAG_PAIRS;
+    bool is_split = flags & (HUFFMAN_FLAG_STREAMS | HUFFMAN_FLAG_CHUNKS);
+    /// Block tables, contexts and pairs each replace the single table, so they exclude each other
+    size_t nof_table_layouts = is_block_tables + has_contexts + has_pairs;
+    if ((nof_table_layouts && (is_split || !(flags & HUFFMAN_FLAG_LENGTH))) || (has_table_map && !is_block_tables) || nof_table_layouts > 1) {
+        fprintf(stderr, "ERR huffman_decompress: Invalid combination of format flags 0x%02X\n", flags);
+        set_error(Error_InvalidFormat);
+        DECOMPRESS_ERROR_GUARD();
+    }
+
+    if (flags & HUFFMAN_FLAG_STREAMS) {
+        nof_streams = bit_array_read_n(&input, 8) + 1;
+        DECOMPRESS_ERROR_GUARD();
+    }
+
+    if (flags & HUFFMAN_FLAG_CHUNKS) {
+        chunk_size = bit_array_read_n(&input, 32);
+        DECOMPRESS_ERROR_GUARD();
+
+        if (!chunk_size) {
+            fprintf(stderr, "ERR huffman_decompress: Chunk size cannot be zero\n");
+            set_error(Error_InvalidFormat);
+            DECOMPRESS_ERROR_GUARD();
+        }
+    }
+
+    if (flags & (HUFFMAN_FLAG_CHUNKS | HUFFMAN_FLAG_LENGTH)) {
+        decoded_len = bit_array_read_n(&input, 64);
+        DECOMPRESS_ERROR_GUARD();
+    }
+
+    log("Decoding symbol list");
+    Symbols symbols;
+    bool has_eof = !(flags & HUFFMAN_FLAG_LENGTH);
+    if (flags & HUFFMAN_FLAG_COMPACT_TABLE) {
+        symbols_decode_compact(&symbols, has_eof, &input);
+    } else {
+        symbols_decode(&symbols, has_eof, &input);
+    }
+    DECOMPRESS_ERROR_GUARD();
+
+    /// Every symbol takes at least one bit, this keeps a broken header from allocating too much
+    if (!has_eof && decoded_len / (has_pairs ? 2 : 1) > input.len - input.cursor) {
+        fprintf(stderr, "ERR huffman_decompress: Length of %ld bytes is out of the data\n", decoded_len);
+        set_error(Error_InvalidFormat);
+        DECOMPRESS_ERROR_GUARD();
+    }
+
+    log("Building decode table");
+    DecodeTable table;
+    decode_table_build(&table, &symbols);
+    DECOMPRESS_ERROR_GUARD();
+
+    if (mode == HuffmanDecodeMode_Auto) {
+        mode = multi_decode_is_worth(&symbols) ? HuffmanDecodeMode_Multi : HuffmanDecodeMode_Single;
+
+        /// A large single stream is split across the cores even without any index
+        bool is_single = !(flags & (HUFFMAN_FLAG_STREAMS | HUFFMAN_FLAG_CHUNKS | HUFFMAN_FLAG_BLOCK_TABLES | HUFFMAN_FLAG_CONTEXTS | HUFFMAN_FLAG_PAIRS));
+        if (is_single && thread_pool_nof_cpus() > 1 && len - input.cursor / 8 >= SPECULATIVE_AUTO_MIN_BYTES) {
+            mode = HuffmanDecodeMode_Speculative;
+        }
+    }
+
+    log("Decompressing");
+    if (is_block_tables) {
+        /// Runs with their own table are decoded one after another from a single stream
+        huffman_decode_block_tables(&table, &input, mode, has_table_map, decoded_len, &result);
+    } else if (has_contexts) {
+        /// The table of every symbol depends on the previous one, so they are decoded one by one
+        huffman_decode_contexts(&table, &input, decoded_len, &result);
+    } else if (has_pairs) {
+        /// Every symbol stands for two bytes
+        huffman_decode_pairs(&table, &input, mode, decoded_len, &result);
+    } else if (flags & HUFFMAN_FLAG_CHUNKS) {
+        /// Chunks are decoded in parallel straight into their place in the output
+        huffman_decode_chunks(&table, &input, mode, nof_streams, chunk_size, decoded_len, &result);
+    } else if (nof_streams > 1) {
+        /// Interleaved streams are consumed one symbol at a time in round robin
+        huffman_decode_streams(&table, &input, nof_streams, decoded_len, &result);
+    } else {
+        BitReader reader = bit_reader_new(&input);
+        DECOMPRESS_ERROR_GUARD(decode_table_free(&table));
+
+        if (mode == HuffmanDecodeMode_Speculative) {
+            huffman_decode_speculative(&table, &reader, decoded_len, &result);
+        } else {
+            huffman_decode_serial(&table, &reader, mode, decoded_len, &result);
+        }
+    }
+
+    DECOMPRESS_ERROR_GUARD(decode_table_free(&table));
+
+    bit_array_free(&input);
+    decode_table_free(&table);
+
+    return result;
+}
+
+void huffman_encode(SegmentList *input, CodeBook codebook, size_t nof_bits, size_t nof_threads, BitArray *output) {
+    if (nof_threads > 1) {
+        huffman_encode_parallel(input, codebook, nof_bits, nof_threads, output);
+        return;
+    }
+
+    CodeBook reversed;
+    codebook_reverse(codebook, reversed);
+
+    BitWriter writer = bit_writer_new(output, nof_bits);
+    if (got_error()) return;
+
+    for (size_t s = 0; s < input->size; s++) {
+        uint8_t *bytes = input->items[s].data;
+        size_t len = input->items[s].len;
+
+        for (size_t i = 0; i < len; i++) {
+            Code code = reversed[bytes[i]];
+            bit_writer_push(&writer, code.code, code.len);
+        }
+    }
+
+    /// Of zero length when the decoded length is stored instead
+    Code eof = reversed[EOF_BYTE];
+    logfmt("Pushing EOF as %ld with length %d", codebook[EOF_BYTE].code, eof.len);
+    bit_writer_push(&writer, eof.code, eof.len);
+    bit_writer_finish(&writer);
+}
+
+size_t huffman_encode_nof_threads(SegmentList *input, size_t nof_threads) {
+    if (!nof_threads) {
+        nof_threads = segment_list_byte_len(input) / PARALLEL_ENCODE_MIN_BYTES;
+
+        if (nof_threads > thread_pool_nof_cpus()) {
+            nof_threads = thread_pool_nof_cpus();
+        }
+    }
+
+    return nof_threads < THREAD_POOL_MAX_THREADS ? nof_threads : THREAD_POOL_MAX_THREADS;
+}
+
+void huffman_encode_parallel(SegmentList *input, CodeBook codebook, size_t nof_bits, size_t nof_parts, BitArray *output) {
+    EncodePart parts[THREAD_POOL_MAX_THREADS] = {0};
+    size_t len = segment_list_byte_len(input);
+
+    /// Parts of about the same length, they may start in the middle of a segment
+    size_t s = 0;
+    size_t s_offset = 0;
+
+    for (size_t k = 0; k < nof_parts; k++) {
+        parts[k].segment = s;
+        parts[k].offset = s_offset;
+        parts[k].len = len / nof_parts + (k < len % nof_parts);
+
+        for (size_t remaining = parts[k].len; remaining;) {
+            size_t available = input->items[s].len - s_offset;
+            size_t n = available < remaining ? available : remaining;
+
+            s_offset += n;
+            remaining -= n;
+
+            if (s_offset == input->items[s].len) {
+                s += 1;
+                s_offset = 0;
+            }
+        }
+    }
+
+    /// Extra word of room, the same as the serial writer
+    bit_array_reserve(output, (output->len % 8 + nof_bits + 7) / 8 + 8);
+    if (got_error()) return;
+
+    CodeBook reversed;
+    codebook_reverse(codebook, reversed);
+
+    PartEncoder encoder = {
+        .input = input,
+        .codebook = codebook,
+        .reversed = reversed,
+        .parts = parts,
+        .output = output,
+    };
+
+    thread_pool_run(huffman_encode_part_len, &encoder, nof_parts, nof_parts);
+    if (got_error()) return;
+
+    /// Prefix sum of the code lengths gives the position of every part
+    size_t start = output->len;
+    for (size_t k = 0; k < nof_parts; k++) {
+        parts[k].start = start;
+        start += parts[k].nof_bits;
+    }
+
+    thread_pool_run(huffman_encode_part, &encoder, nof_parts, nof_parts);
+    if (got_error()) return;
+
+    /// The last partial word of a part shares a byte with the next one, so they are merged in order
+    for (size_t k = 0; k < nof_parts; k++) {
+        BitWriter *writer = &parts[k].writer;
+
+        for (size_t i = 0; i < (writer->count + 7) / 8; i++) {
+            output->data[writer->index + i] |= writer->buffer >> (i * 8);
+        }
+    }
+
+    output->len = start;
+
+    Code eof = reversed[EOF_BYTE];
+    BitWriter writer = bit_writer_new(output, eof.len);
+    if (got_error()) return;
+
+    bit_writer_push(&writer, eof.code, eof.len);
+    bit_writer_finish(&writer);
+}
+
+void huffman_encode_part_len(void *context, size_t index) {
+    PartEncoder *encoder = context;
+    EncodePart *part = &encoder->parts[index];
+    SegmentList *input = encoder->input;
+    size_t nof_bits = 0;
+    size_t s = part->segment;
+    size_t offset = part->offset;
+
+    for (size_t remaining = part->len; remaining; s++, offset = 0) {
+        uint8_t *bytes = input->items[s].data + offset;
+        size_t n = input->items[s].len - offset < remaining ? input->items[s].len - offset : remaining;
+
+        for (size_t i = 0; i < n; i++) {
+            nof_bits += encoder->codebook[bytes[i]].len;
+        }
+
+        remaining -= n;
+    }
+
+    part->nof_bits = nof_bits;
+}
+
+void huffman_encode_part(void *context, size_t index) {
+    PartEncoder *encoder = context;
+    EncodePart *part = &encoder->parts[index];
+    SegmentList *input = encoder->input;
+    size_t s = part->segment;
+    size_t offset = part->offset;
+
+    /// Bytes of the previous part are never stored by another thread, the leading bits
+    /// of the first byte are already in place (header) or still zero (previous part)
+    BitWriter writer = {
+        .arr = encoder->output,
+        .index = part->start / 8,
+        .buffer = part->start % 8 ? encoder->output->data[part->start / 8] : 0,
+        .count = part->start % 8,
+    };
+
+    for (size_t remaining = part->len; remaining; s++, offset = 0) {
+        uint8_t *bytes = input->items[s].data + offset;
+        size_t n = input->items[s].len - offset < remaining ? input->items[s].len - offset : remaining;
+
+        for (size_t i = 0; i < n; i++) {
+            Code code = encoder->reversed[bytes[i]];
+            bit_writer_push(&writer, code.code, code.len);
+        }
+
+        remaining -= n;
+    }
+
+    part->writer = writer;
+}
+
+void huffman_encode_streams(SegmentList *input, CodeBook codebook, size_t nof_streams, BitArray *header, SegmentList *output) {
+    CodeBook reversed;
+    codebook_reverse(codebook, reversed);
+
+    /// Exact size of every stream so that each writer is reserved at once
+    size_t nof_bits[HUFFMAN_MAX_STREAMS];
+    for (size_t j = 0; j < nof_streams; j++) {
+        nof_bits[j] = codebook[EOF_BYTE].len;
+    }
+
+    size_t stream = 0;
+    for (size_t s = 0; s < input->size; s++) {
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            nof_bits[stream] += codebook[input->items[s].data[i]].len;
+            if (++stream == nof_streams) stream = 0;
+        }
+    }
+
+    BitArray streams[HUFFMAN_MAX_STREAMS];
+    BitWriter writers[HUFFMAN_MAX_STREAMS];
+
+    for (size_t j = 0; j < nof_streams; j++) {
+        streams[j] = bit_array_new(NULL, 0);
+    }
+
+    for (size_t j = 0; j < nof_streams && !got_error(); j++) {
+        writers[j] = bit_writer_new(&streams[j], nof_bits[j]);
+    }
+
+    /// Symbol `i` goes into stream `i % nof_streams`, every stream is terminated by its own EOF
+    stream = 0;
+    for (size_t s = 0; s < input->size && !got_error(); s++) {
+        uint8_t *bytes = input->items[s].data;
+        size_t len = input->items[s].len;
+
+        for (size_t i = 0; i < len; i++) {
+            Code code = reversed[bytes[i]];
+            bit_writer_push(&writers[stream], code.code, code.len);
+            if (++stream == nof_streams) stream = 0;
+        }
+    }
+
+    for (size_t j = 0; j < nof_streams && !got_error(); j++) {
+        bit_writer_push(&writers[j], reversed[EOF_BYTE].code, reversed[EOF_BYTE].len);
+        bit_writer_finish(&writers[j]);
+        bit_array_pad_to_byte(&streams[j]);
+    }
+
+    /// Jump table, the size of the last stream is implied by the end of the data
+    for (size_t j = 0; j + 1 < nof_streams && !got_error(); j++) {
+        size_t size = bit_array_byte_len(&streams[j]);
+
+        if (size > UINT32_MAX) {
+            fprintf(stderr, "ERR huffman_encode_streams: Stream is too large for the jump table\n");
+            set_error(Error_InternalError);
+            break;
+        }
+
+        bit_array_push_n(header, size, 32);
+    }
+
+    /// The streams are handed over as they are, without joining them
+    if (!got_error()) {
+        bit_array_pad_to_byte(header);
+        segment_list_push(output, header);
+    }
+
+    for (size_t j = 0; j < nof_streams; j++) {
+        if (!got_error()) {
+            segment_list_push(output, &streams[j]);
+        }
+
+        bit_array_free(&streams[j]);
+    }
+}
+
+void huffman_decode_serial(DecodeTable *table, BitReader *reader, HuffmanDecodeMode mode, size_t len, BitArray *output) {
+    if (table->has_eof) {
+        if (mode == HuffmanDecodeMode_Multi) {
+            huffman_decode_multi(table, reader, output);
+        } else {
+            huffman_decode_single(table, reader, output);
+        }
+
+        return;
+    }
+
+    /// The length is known, so the output is allocated at once and filled by a loop of a fixed count
+    MultiDecodeTable multi;
+    if (mode == HuffmanDecodeMode_Multi) {
+        log("Building multi-symbol decode table");
+        multi_decode_table_build(multi, table);
+    }
+
+    bit_array_reserve(output, len);
+    if (got_error()) return;
+
+    huffman_decode_exact(table, mode == HuffmanDecodeMode_Multi ? multi : NULL, reader, output->data, len);
+    if (!got_error()) huffman_expect_eof(table, reader);
+
+    if (!got_error()) {
+        output->len = len * 8;
+    }
+}
+
+void huffman_decode_single(DecodeTable *table, BitReader *reader, BitArray *output) {
+    uint16_t byte;
+
+    while ((byte = decode_table_read_next(table, reader)) != EOF_BYTE) {
+        if (got_error()) return;
+
+        logfmt("Decompressed 0x%02X", byte);
+
+        bit_array_push_n(output, byte, 8);
+        if (got_error()) return;
+    }
+}
+
+void huffman_decode_multi(DecodeTable *table, BitReader *reader, BitArray *output) {
+    log("Building multi-symbol decode table");
+    MultiDecodeTable multi;
+    multi_decode_table_build(multi, table);
+
+    while (true) {
+        MultiDecodeEntry entry = multi[bit_reader_peek(reader, DECODE_TABLE_BITS)];
+
+        if (!entry.count) {
+            /// Long code or EOF, resolve it through the regular table
+            uint16_t byte = decode_table_read_next(table, reader);
+            if (got_error() || byte == EOF_BYTE) return;
+
+            bit_array_push_n(output, byte, 8);
+            if (got_error()) return;
+            continue;
+        }
+
+        bit_reader_consume(reader, entry.len);
+        if (bit_reader_overrun(reader)) {
+            set_error(Error_IndexOutOfBound);
+            return;
+        }
+
+        uint64_t packed = 0;
+        for (int i = 0; i < entry.count; i++) {
+            packed |= (uint64_t)entry.symbols[i] << (i * 8);
+        }
+
+        bit_array_push_n(output, packed, entry.count * 8);
+        if (got_error()) return;
+    }
+}
+
+void huffman_decode_streams(DecodeTable *table, BitArray *input, size_t nof_streams, size_t len, BitArray *output) {
+    size_t sizes[HUFFMAN_MAX_STREAMS];
+
+    for (size_t j = 0; j + 1 < nof_streams; j++) {
+        sizes[j] = bit_array_read_n(input, 32);
+        if (got_error()) return;
+    }
+
+    /// Streams start at the next byte boundary
+    input->cursor = (input->cursor + 7) / 8 * 8;
+    size_t offset = input->cursor / 8;
+    size_t total = bit_array_byte_len(input);
+
+    BitReader reader = bit_reader_new(input);
+    if (got_error()) return;
+
+    BitReader streams[HUFFMAN_MAX_STREAMS];
+
+    for (size_t j = 0; j < nof_streams; j++) {
+        size_t size = j + 1 < nof_streams ? sizes[j] : total - offset;
+
+        if (offset > total || size > total - offset) {
+            fprintf(stderr, "ERR huffman_decode_streams: Stream %ld is out of the data\n", j);
+            set_error(Error_IndexOutOfBound);
+            return;
+        }
+
+        streams[j] = bit_reader_sub(&reader, offset, size);
+        offset += size;
+    }
+
+    if (!table->has_eof) {
+        bit_array_reserve(output, len);
+        if (got_error()) return;
+
+        huffman_decode_interleaved(table, streams, nof_streams, output->data, len);
+
+        if (!got_error()) {
+            output->len = len * 8;
+        }
+
+        return;
+    }
+
+    while (true) {
+        for (size_t j = 0; j < nof_streams; j++) {
+            uint16_t byte = decode_table_read_next(table, &streams[j]);
+            if (got_error() || byte == EOF_BYTE) return;
+
+            bit_array_push_n(output, byte, 8);
+            if (got_error()) return;
+        }
+    }
+}
+
+size_t huffman_encoded_bit_len(SegmentList *input, CodeBook codebook) {
+    size_t nof_bits = codebook[EOF_BYTE].len;
+
+    for (size_t s = 0; s < input->size; s++) {
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            nof_bits += codebook[input->items[s].data[i]].len;
+        }
+    }
+
+    return nof_bits;
+}
+
+void huffman_encode_payload(SegmentList *input, CodeBook codebook, size_t nof_streams, SegmentList *output) {
+    BitArray payload = bit_array_new(NULL, 0);
+
+    if (nof_streams > 1) {
+        huffman_encode_streams(input, codebook, nof_streams, &payload, output);
+    } else {
+        huffman_encode(input, codebook, huffman_encoded_bit_len(input, codebook), 1, &payload);
+
+        if (!got_error()) {
+            segment_list_push(output, &payload);
+        }
+    }
+
+    bit_array_free(&payload);
+}
+
+void huffman_encode_chunks(SegmentList *input, CodeBook codebook, size_t nof_streams, size_t chunk_size, BitArray *header, SegmentList *output) {
+    size_t len = segment_list_byte_len(input);
+    size_t nof_chunks = (len + chunk_size - 1) / chunk_size;
+    SegmentList chunks = segment_list_new();
+
+    /// Position in the input, chunks may start in the middle of a segment
+    size_t s = 0;
+    size_t s_offset = 0;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < nof_chunks && !got_error(); i++) {
+        SegmentList slice = segment_list_new();
+        SegmentList chunk = segment_list_new();
+        size_t remaining = len - i * chunk_size < chunk_size ? len - i * chunk_size : chunk_size;
+
+        while (remaining && !got_error()) {
+            Segment *segment = &input->items[s];
+            size_t n = segment->len - s_offset < remaining ? segment->len - s_offset : remaining;
+
+            segment_list_push_bytes(&slice, segment->data + s_offset, n);
+            s_offset += n;
+            remaining -= n;
+
+            if (s_offset == segment->len) {
+                s += 1;
+                s_offset = 0;
+            }
+        }
+
+        /// Offset index, the first chunk always starts right after it
+        if (i) {
+            bit_array_push_n(header, offset, 64);
+        }
+
+        if (!got_error()) {
+            huffman_encode_payload(&slice, codebook, nof_streams, &chunk);
+        }
+
+        offset += segment_list_byte_len(&chunk);
+        segment_list_append(&chunks, &chunk);
+
+        segment_list_free(&slice);
+        segment_list_free(&chunk);
+    }
+
+    if (!got_error()) {
+        bit_array_pad_to_byte(header);
+        segment_list_push(output, header);
+        segment_list_append(output, &chunks);
+    }
+
+    segment_list_free(&chunks);
+}
+
+void huffman_decode_chunks(DecodeTable *table, BitArray *input, HuffmanDecodeMode mode, size_t nof_streams, size_t chunk_size, size_t len, BitArray *output) {
+    size_t nof_chunks = len ? (len - 1) / chunk_size + 1 : 0;
+
+    /// Every chunk takes at least one byte, this keeps a broken header from allocating too much
+    if (nof_chunks > bit_array_byte_len(input)) {
+        fprintf(stderr, "ERR huffman_decode_chunks: Index of %ld chunks is out of the data\n", nof_chunks);
+        set_error(Error_InvalidFormat);
+        return;
+    }
+
+    size_t *offsets = malloc((nof_chunks + 1) * sizeof(size_t));
+    if (!offsets) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    offsets[0] = 0;
+    for (size_t i = 1; i < nof_chunks && !got_error(); i++) {
+        offsets[i] = bit_array_read_n(input, 64);
+    }
+
+    /// Chunks start at the next byte boundary
+    input->cursor = (input->cursor + 7) / 8 * 8;
+    size_t base = input->cursor / 8;
+    size_t total = bit_array_byte_len(input);
+    offsets[nof_chunks] = base < total ? total - base : 0;
+
+    for (size_t i = 0; i < nof_chunks && !got_error(); i++) {
+        if (offsets[i] > offsets[i + 1] || base > total) {
+            fprintf(stderr, "ERR huffman_decode_chunks: Chunk %ld is out of the data\n", i);
+            set_error(Error_IndexOutOfBound);
+        }
+    }
+
+    BitReader reader = {0};
+    if (!got_error()) {
+        reader = bit_reader_new(input);
+        bit_array_reserve(output, len);
+    }
+
+    MultiDecodeTable multi;
+    if (!got_error() && mode == HuffmanDecodeMode_Multi && nof_streams == 1) {
+        log("Building multi-symbol decode table");
+        multi_decode_table_build(multi, table);
+    }
+
+    ChunkDecoder decoder = {
+        .table = table,
+        .multi = mode == HuffmanDecodeMode_Multi ? multi : NULL,
+        .reader = &reader,
+        .base = base,
+        .offsets = offsets,
+        .nof_streams = nof_streams,
+        .chunk_size = chunk_size,
+        .len = len,
+        .output = output->data,
+    };
+
+    if (!got_error()) {
+        thread_pool_run(huffman_decode_chunk, &decoder, nof_chunks, 0);
+    }
+
+    if (!got_error()) {
+        output->len = len * 8;
+    }
+
+    free(offsets);
+}
+
+void huffman_decode_chunk(void *context, size_t index) {
+    ChunkDecoder *decoder = context;
+    size_t start = index * decoder->chunk_size;
+    size_t len = decoder->len - start < decoder->chunk_size ? decoder->len - start : decoder->chunk_size;
+    size_t offset = decoder->offsets[index];
+
+    BitReader reader = bit_reader_sub(decoder->reader, decoder->base + offset, decoder->offsets[index + 1] - offset);
+
+    if (decoder->nof_streams > 1) {
+        huffman_decode_streams_exact(decoder->table, &reader, decoder->nof_streams, decoder->output + start, len);
+    } else {
+        huffman_decode_exact(decoder->table, decoder->multi, &reader, decoder->output + start, len);
+        if (!got_error()) huffman_expect_eof(decoder->table, &reader);
+    }
+}
+
+void huffman_decode_exact(DecodeTable *table, MultiDecodeEntry *multi, BitReader *reader, uint8_t *output, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        /// Whole multi-symbol entries as long as they cannot run past the end
+        if (multi && i + MULTI_DECODE_MAX_SYMBOLS <= len) {
+            MultiDecodeEntry entry = multi[bit_reader_peek(reader, DECODE_TABLE_BITS)];
+
+            if (entry.count) {
+                bit_reader_consume(reader, entry.len);
+                memcpy(output + i, entry.symbols, MULTI_DECODE_MAX_SYMBOLS);
+                i += entry.count;
+                continue;
+            }
+        }
+
+        uint16_t byte = decode_table_read_next(table, reader);
+        if (got_error()) return;
+
+        if (byte == EOF_BYTE) {
+            fprintf(stderr, "ERR huffman_decode_exact: Unexpected end of the data\n");
+            set_error(Error_InvalidFormat);
+            return;
+        }
+
+        output[i++] = byte;
+    }
+}
+
+void huffman_decode_streams_exact(DecodeTable *table, BitReader *reader, size_t nof_streams, uint8_t *output, size_t len) {
+    BitReader streams[HUFFMAN_MAX_STREAMS];
+    size_t offset = (nof_streams - 1) * 4;
+
+    if (offset > reader->nof_bytes) {
+        fprintf(stderr, "ERR huffman_decode_streams: Jump table is out of the data\n");
+        set_error(Error_IndexOutOfBound);
+        return;
+    }
+
+    for (size_t j = 0; j < nof_streams; j++) {
+        size_t size = j + 1 < nof_streams ? bit_reader_read(reader, 32) : reader->nof_bytes - offset;
+        if (got_error()) return;
+
+        if (size > reader->nof_bytes - offset) {
+            fprintf(stderr, "ERR huffman_decode_streams: Stream %ld is out of the data\n", j);
+            set_error(Error_IndexOutOfBound);
+            return;
+        }
+
+        streams[j] = bit_reader_sub(reader, offset, size);
+        offset += size;
+    }
+
+    huffman_decode_interleaved(table, streams, nof_streams, output, len);
+}
+
+void huffman_decode_interleaved(DecodeTable *table, BitReader *streams, size_t nof_streams, uint8_t *output, size_t len) {
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint16_t byte = decode_table_read_next(table, &streams[j]);
+        if (got_error()) return;
+
+        if (byte == EOF_BYTE) {
+            fprintf(stderr, "ERR huffman_decode_streams: Unexpected end of the data\n");
+            set_error(Error_InvalidFormat);
+            return;
+        }
+
+        output[i] = byte;
+        if (++j == nof_streams) j = 0;
+    }
+
+    for (j = 0; j < nof_streams && !got_error(); j++) {
+        huffman_expect_eof(table, &streams[j]);
+    }
+}
+
+void huffman_expect_eof(DecodeTable *table, BitReader *reader) {
+    /// Without EOF, only the padding up to the next byte may follow. This also catches the overrun of multi-symbol lookups.
+    if (!table->has_eof) {
+        if (bit_reader_overrun(reader)) {
+            set_error(Error_IndexOutOfBound);
+        } else if (reader->len - reader->cursor >= 8) {
+            fprintf(stderr, "ERR huffman_decode: Data continues past its length\n");
+            set_error(Error_InvalidFormat);
+        }
+
+        return;
+    }
+
+    uint16_t byte = decode_table_read_next(table, reader);
+    if (got_error()) return;
+
+    if (byte != EOF_BYTE) {
+        fprintf(stderr, "ERR huffman_decode: Data continues past its length\n");
+        set_error(Error_InvalidFormat);
+    }
+}
+
+void huffman_decode_speculative(DecodeTable *table, BitReader *reader, size_t len, BitArray *output) {
+    size_t nof_bits = reader->len > reader->cursor ? reader->len - reader->cursor : 0;
+    size_t nof_parts = nof_bits / 8 / SPECULATIVE_MIN_BYTES;
+    size_t max_parts = thread_pool_nof_cpus() > SPECULATIVE_MIN_PARTS ? thread_pool_nof_cpus() : SPECULATIVE_MIN_PARTS;
+
+    if (nof_parts > max_parts) nof_parts = max_parts;
+    if (nof_parts > THREAD_POOL_MAX_THREADS) nof_parts = THREAD_POOL_MAX_THREADS;
+
+    if (nof_parts < 2) {
+        huffman_decode_serial(table, reader, HuffmanDecodeMode_Single, len, output);
+        return;
+    }
+
+    SpeculativePart *parts = calloc(nof_parts, sizeof(SpeculativePart));
+    if (!parts) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    /// Every part but the first starts at a guessed position, most likely in the middle of a code
+    for (size_t k = 0; k < nof_parts; k++) {
+        parts[k].reader = *reader;
+        bit_reader_seek(&parts[k].reader, reader->cursor + nof_bits * k / nof_parts);
+        parts[k].end = reader->cursor + nof_bits * (k + 1) / nof_parts;
+    }
+
+    SpeculativeDecoder decoder = {
+        .table = table,
+        .parts = parts,
+        .nof_parts = nof_parts,
+        .len = len,
+    };
+
+    thread_pool_run(huffman_decode_speculative_part, &decoder, nof_parts, nof_parts);
+    if (!got_error()) {
+        thread_pool_run(huffman_decode_speculative_sync, &decoder, nof_parts - 1, nof_parts - 1);
+    }
+
+    bool is_joined = !got_error() && huffman_decode_speculative_join(&decoder, output);
+
+    for (size_t k = 0; k < nof_parts; k++) {
+        bit_array_free(&parts[k].output);
+    }
+
+    free(parts);
+
+    /// The guess did not work out, the stream is still decoded correctly, only serially
+    if (!got_error() && !is_joined) {
+        log("Speculative decoding failed, decoding serially");
+        bit_array_free(output);
+        *output = bit_array_new(NULL, 0);
+        huffman_decode_serial(table, reader, HuffmanDecodeMode_Single, len, output);
+    }
+}
+
+void huffman_decode_speculative_part(void *context, size_t index) {
+    SpeculativeDecoder *decoder = context;
+    SpeculativePart *part = &decoder->parts[index];
+
+    while (part->reader.cursor < part->end && !part->is_done) {
+        size_t position = part->reader.cursor;
+        uint16_t byte = decode_table_read_next(decoder->table, &part->reader);
+
+        /// Garbage before the synchronization may be anything, it is not an error of the stream
+        if (got_error()) {
+            clear_error();
+            part->is_failed = true;
+            return;
+        }
+
+        if (part->nof_boundaries < SPECULATIVE_BOUNDARIES) {
+            part->boundaries[part->nof_boundaries++] = position;
+        } else if (byte == EOF_BYTE) {
+            /// Past the boundaries the part is either discarded or right
+            part->is_done = true;
+        }
+
+        if (byte == EOF_BYTE) {
+            if (part->nof_eofs == SPECULATIVE_MAX_EOFS) {
+                part->is_failed = true;
+                return;
+            }
+
+            part->eofs[part->nof_eofs++] = bit_array_byte_len(&part->output);
+            byte = 0;
+        }
+
+        bit_array_push_n(&part->output, byte, 8);
+        if (got_error()) return;
+    }
+}
+
+void huffman_decode_speculative_sync(void *context, size_t index) {
+    SpeculativeDecoder *decoder = context;
+    SpeculativePart *part = &decoder->parts[index];
+    SpeculativePart *next = &decoder->parts[index + 1];
+    size_t j = 0;
+
+    if (part->is_failed || part->is_done) return;
+
+    /// Continue into the next part until both decoders stand on the same code boundary,
+    /// from there on the next part decodes exactly what this one would
+    while (true) {
+        while (j < next->nof_boundaries && next->boundaries[j] < part->reader.cursor) {
+            j += 1;
+        }
+
+        if (j == next->nof_boundaries) {
+            part->is_failed = true;
+            return;
+        }
+
+        if (next->boundaries[j] == part->reader.cursor) {
+            part->sync = j;
+            return;
+        }
+
+        uint16_t byte = decode_table_read_next(decoder->table, &part->reader);
+
+        if (got_error()) {
+            clear_error();
+            part->is_failed = true;
+            return;
+        }
+
+        if (byte == EOF_BYTE) {
+            if (part->nof_eofs == SPECULATIVE_MAX_EOFS) {
+                part->is_failed = true;
+            } else {
+                part->eofs[part->nof_eofs++] = bit_array_byte_len(&part->output);
+                part->is_done = true;
+            }
+
+            return;
+        }
+
+        bit_array_push_n(&part->output, byte, 8);
+        if (got_error()) return;
+    }
+}
+
+bool huffman_decode_speculative_join(SpeculativeDecoder *decoder, BitArray *output) {
+    size_t skip = 0;
+
+    for (size_t k = 0; k < decoder->nof_parts; k++) {
+        SpeculativePart *part = &decoder->parts[k];
+        size_t len = bit_array_byte_len(&part->output);
+        bool is_done = false;
+
+        /// The first part is always right, the others only from their synchronization on,
+        /// so the first EOF after that is the real one
+        for (size_t i = 0; i < part->nof_eofs; i++) {
+            if (part->eofs[i] >= skip) {
+                len = part->eofs[i];
+                is_done = true;
+                break;
+            }
+        }
+
+        /// Without EOF the length tells where the data ends, the last part decodes the padding as garbage
+        size_t missing = decoder->len - bit_array_byte_len(output);
+        if (!decoder->table->has_eof && skip <= len && len - skip >= missing) {
+            len = skip + missing;
+            is_done = true;
+        }
+
+        if ((part->is_failed && !is_done) || skip > len) return false;
+
+        bit_array_reserve(output, len - skip);
+        if (got_error()) return false;
+
+        if (len > skip) {
+            memcpy(output->data + output->len / 8, part->output.data + skip, len - skip);
+        }
+
+        output->len += (len - skip) * 8;
+
+        if (is_done) return true;
+
+        skip = part->sync;
+    }
+
+    /// The last part ran out of the data without EOF or before the length
+    return false;
+}
+
+void huffman_plan_block_tables(SegmentList *input, size_t max_code_len, Symbols *shared, BlockRun **runs, size_t *nof_runs) {
+    *runs = malloc((input->size ? input->size : 1) * sizeof(BlockRun));
+    *nof_runs = 0;
+
+    if (!*runs) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    /// Code lengths of the table shared by the whole input
+    uint8_t lens[ALPHABET_LEN] = {0};
+    symbols_from_segments(shared, input, false);
+    symbols_build_code_len(shared, max_code_len);
+    if (got_error()) return;
+
+    for (size_t i = 0; i < shared->size; i++) {
+        lens[shared->data[i].character] = shared->data[i].code.len;
+    }
+
+    for (size_t s = 0; s < input->size; s++) {
+        Segment *segment = &input->items[s];
+        Frequency freq[ALPHABET_LEN] = {0};
+        histogram_count(freq, segment->data, segment->len);
+
+        size_t shared_bits = 0;
+        for (size_t c = 0; c < ALPHABET_LEN; c++) {
+            shared_bits += freq[c] * lens[c];
+        }
+
+        /// An own table splits the surrounding run, which costs one more run header
+        Symbols own;
+        symbols_from_frequencies(&own, freq);
+        symbols_build_code_len(&own, max_code_len);
+        if (got_error()) return;
+
+        size_t own_bits = symbols_encoded_bit_len(&own) + symbols_compact_bit_len(&own) + 2 * (run_len_bits(segment->len) + 1);
+        bool is_own = own_bits < shared_bits;
+
+        BlockRun *last = *nof_runs ? &(*runs)[*nof_runs - 1] : NULL;
+        if (last && !last->is_own && !is_own) {
+            last->nof_segments += 1;
+            last->len += segment->len;
+            continue;
+        }
+
+        BlockRun run = { .segment = s, .nof_segments = 1, .len = segment->len, .is_own = is_own };
+        (*runs)[(*nof_runs)++] = run;
+    }
+
+    /// The shared table is rebuilt from the runs that actually use it
+    Frequency freq[ALPHABET_LEN] = {0};
+    for (size_t r = 0; r < *nof_runs; r++) {
+        for (size_t s = 0; !(*runs)[r].is_own && s < (*runs)[r].nof_segments; s++) {
+            Segment *segment = &input->items[(*runs)[r].segment + s];
+            histogram_count(freq, segment->data, segment->len);
+        }
+    }
+
+    symbols_from_frequencies(shared, freq);
+}
+
+void huffman_encode_block_tables(SegmentList *input, CodeBook codebook, Symbols *tables, size_t nof_tables, BlockRun *runs, size_t nof_runs, size_t max_code_len, size_t nof_threads, BitArray *output) {
+    /// With a table map, all the tables but the shared one follow it, each run only stores an index
+    CodeBook *codebooks = malloc((nof_tables ? nof_tables : 1) * sizeof(CodeBook));
+    if (!codebooks) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    if (nof_tables) {
+        bit_array_push_n(output, nof_tables - 1, 8);
+        memcpy(codebooks[0], codebook, sizeof(CodeBook));
+    }
+
+    for (size_t t = 1; t < nof_tables && !got_error(); t++) {
+        symbols_encode_compact(&tables[t], output);
+        symbols_to_codebook(&tables[t], codebooks[t]);
+    }
+
+    bit_array_push_n(output, nof_runs, 32);
+
+    for (size_t r = 0; r < nof_runs && !got_error(); r++) {
+        size_t width = run_len_bits(runs[r].len) - RUN_LEN_WIDTH_BITS;
+        bit_array_push_n(output, width, RUN_LEN_WIDTH_BITS);
+        bit_array_push_n(output, runs[r].len, width);
+
+        if (nof_tables) {
+            bit_array_push_n(output, runs[r].table, table_index_bits(nof_tables));
+        } else {
+            bit_array_push_n(output, runs[r].is_own, 1);
+        }
+    }
+
+    for (size_t r = 0; r < nof_runs && !got_error(); r++) {
+        SegmentList run = segment_list_new();
+
+        for (size_t s = 0; s < runs[r].nof_segments && !got_error(); s++) {
+            Segment *segment = &input->items[runs[r].segment + s];
+            segment_list_push_bytes(&run, segment->data, segment->len);
+        }
+
+        /// The own table is stored right before the codes of its run
+        Symbols own;
+        CodeBook own_codebook;
+        Code *current = nof_tables ? codebooks[runs[r].table] : codebook;
+
+        if (!got_error() && runs[r].is_own) {
+            symbols_from_segments(&own, &run, false);
+            symbols_build_code_len(&own, max_code_len);
+            symbols_encode_compact(&own, output);
+            symbols_to_codebook(&own, own_codebook);
+            current = own_codebook;
+        }
+
+        if (!got_error()) {
+            size_t nof_bits = huffman_encoded_bit_len(&run, current);
+            huffman_encode(&run, current, nof_bits, huffman_encode_nof_threads(&run, nof_threads), output);
+        }
+
+        segment_list_free(&run);
+    }
+
+    free(codebooks);
+}
+
+void huffman_decode_block_tables(DecodeTable *table, BitArray *input, HuffmanDecodeMode mode, bool has_table_map, size_t len, BitArray *output) {
+    #define BLOCK_TABLES_ERROR_GUARD() \
+        if (got_error()) { \
+            for (size_t t = 1; tables && t < nof_tables; t++) decode_table_free(&tables[t]); \
+            free(tables); \
+            free(multis); \
+            free(runs); \
+            return; \
+        }
+
+    size_t nof_tables = has_table_map ? bit_array_read_n(input, 8) + 1 : 1;
+    DecodeTable *tables = calloc(nof_tables, sizeof(DecodeTable));
+    MultiDecodeTable *multis = NULL;
+    BlockRun *runs = NULL;
+    bool is_multi = mode == HuffmanDecodeMode_Multi;
+
+    if (!tables) {
+        set_error(Error_OutOfMemory);
+    }
+    BLOCK_TABLES_ERROR_GUARD();
+
+    /// Only the tables of the table map are built, not one per run
+    tables[0] = *table;
+    for (size_t t = 1; t < nof_tables; t++) {
+        Symbols symbols;
+        symbols_decode_compact(&symbols, false, input);
+        BLOCK_TABLES_ERROR_GUARD();
+
+        decode_table_build(&tables[t], &symbols);
+        BLOCK_TABLES_ERROR_GUARD();
+    }
+
+    if (is_multi) {
+        log("Building multi-symbol decode tables");
+        multis = malloc(nof_tables * sizeof(MultiDecodeTable));
+        if (!multis) set_error(Error_OutOfMemory);
+        BLOCK_TABLES_ERROR_GUARD();
+
+        for (size_t t = 0; t < nof_tables; t++) {
+            multi_decode_table_build(multis[t], &tables[t]);
+        }
+    }
+
+    size_t nof_runs = bit_array_read_n(input, 32);
+    BLOCK_TABLES_ERROR_GUARD();
+
+    /// Every run takes its header, this keeps a broken header from allocating too much
+    if (nof_runs > (input->len - input->cursor) / RUN_LEN_WIDTH_BITS) {
+        fprintf(stderr, "ERR huffman_decode_block_tables: %ld runs are out of the data\n", nof_runs);
+        set_error(Error_InvalidFormat);
+    }
+    BLOCK_TABLES_ERROR_GUARD();
+
+    runs = malloc((nof_runs ? nof_runs : 1) * sizeof(BlockRun));
+    if (!runs) set_error(Error_OutOfMemory);
+    BLOCK_TABLES_ERROR_GUARD();
+
+    size_t total = 0;
+    for (size_t r = 0; r < nof_runs && !got_error(); r++) {
+        runs[r].len = bit_array_read_n(input, bit_array_read_n(input, RUN_LEN_WIDTH_BITS));
+        runs[r].table = has_table_map ? bit_array_read_n(input, table_index_bits(nof_tables)) : 0;
+        runs[r].is_own = has_table_map ? false : bit_array_read_n(input, 1);
+
+        if (runs[r].len > len - total || runs[r].table >= nof_tables) {
+            fprintf(stderr, "ERR huffman_decode_block_tables: Run %ld is out of the data\n", r);
+            set_error(Error_InvalidFormat);
+        }
+
+        total += runs[r].len;
+    }
+
+    if (!got_error() && total != len) {
+        fprintf(stderr, "ERR huffman_decode_block_tables: Runs do not cover the data\n");
+        set_error(Error_InvalidFormat);
+    }
+    BLOCK_TABLES_ERROR_GUARD();
+
+    bit_array_reserve(output, len);
+    BLOCK_TABLES_ERROR_GUARD();
+
+    BitReader reader = bit_reader_new(input);
+    BLOCK_TABLES_ERROR_GUARD();
+
+    MultiDecodeTable own_multi;
+    size_t offset = 0;
+    for (size_t r = 0; r < nof_runs && !got_error(); r++) {
+        DecodeTable own = {0};
+        DecodeTable *current = &tables[runs[r].table];
+        MultiDecodeEntry *current_multi = is_multi ? multis[runs[r].table] : NULL;
+
+        if (runs[r].is_own) {
+            Symbols symbols;
+            input->cursor = reader.cursor;
+            symbols_decode_compact(&symbols, false, input);
+            if (got_error()) break;
+
+            decode_table_build(&own, &symbols);
+            if (got_error()) break;
+
+            bit_reader_seek(&reader, input->cursor);
+            current = &own;
+
+            if (is_multi) {
+                multi_decode_table_build(own_multi, &own);
+                current_multi = own_multi;
+            }
+        }
+
+        huffman_decode_exact(current, current_multi, &reader, output->data + offset, runs[r].len);
+        offset += runs[r].len;
+        decode_table_free(&own);
+    }
+
+    if (!got_error()) {
+        huffman_expect_eof(table, &reader);
+    }
+
+    if (!got_error()) {
+        output->len = len * 8;
+    }
+
+    BLOCK_TABLES_ERROR_GUARD();
+    for (size_t t = 1; t < nof_tables; t++) decode_table_free(&tables[t]);
+    free(tables);
+    free(multis);
+    free(runs);
+}
+
+void huffman_cluster_block_tables(SegmentList *input, size_t max_code_len, size_t max_tables, Symbols **tables, size_t *nof_tables, BlockRun **runs, size_t *nof_runs) {
+    size_t n = input->size;
+    size_t k = 1;
+    SparseHistogram *histograms = calloc(n ? n : 1, sizeof(SparseHistogram));
+    Frequency (*centers)[ALPHABET_LEN] = calloc(max_tables, sizeof(*centers));
+    uint8_t (*lens)[ALPHABET_LEN] = calloc(max_tables, sizeof(*lens));
+    size_t *own_bits = calloc(n ? n : 1, sizeof(size_t));
+    size_t *best_bits = calloc(n ? n : 1, sizeof(size_t));
+    size_t *assignment = calloc(n ? n : 1, sizeof(size_t));
+    *tables = NULL;
+    *runs = malloc((n ? n : 1) * sizeof(BlockRun));
+    *nof_runs = 0;
+
+    if (!histograms || !centers || !lens || !own_bits || !best_bits || !assignment || !*runs) {
+        set_error(Error_OutOfMemory);
+    }
+
+    for (size_t s = 0; s < n && !got_error(); s++) {
+        Frequency freq[ALPHABET_LEN] = {0};
+        Symbols own;
+        histogram_count(freq, input->items[s].data, input->items[s].len);
+        symbols_from_frequencies(&own, freq);
+        symbols_build_code_len(&own, max_code_len);
+        own_bits[s] = symbols_encoded_bit_len(&own);
+
+        /// Only the present symbols are kept, small blocks use a fraction of the alphabet
+        for (size_t c = 0; c < HISTOGRAM_LEN; c++) {
+            if (!freq[c]) continue;
+
+            histograms[s].symbols[histograms[s].size] = c;
+            histograms[s].counts[histograms[s].size++] = freq[c];
+            centers[0][c] += freq[c];
+        }
+    }
+
+    if (!got_error()) {
+        clusters_build_lens(centers[0], max_code_len, lens[0]);
+    }
+
+    for (size_t s = 0; s < n && !got_error(); s++) {
+        best_bits[s] = clusters_segment_bits(&histograms[s], lens, 1, max_code_len, NULL);
+    }
+
+    /// Seeded by the segments coded the worst by the tables picked so far, far from all of them
+    while (k < max_tables && !got_error()) {
+        size_t worst = 0;
+        size_t worst_excess = 0;
+
+        for (size_t s = 0; s < n; s++) {
+            size_t excess = best_bits[s] > own_bits[s] ? best_bits[s] - own_bits[s] : 0;
+
+            if (excess > worst_excess) {
+                worst = s;
+                worst_excess = excess;
+            }
+        }
+
+        if (!worst_excess) break;
+
+        for (size_t i = 0; i < histograms[worst].size; i++) {
+            centers[k][histograms[worst].symbols[i]] = histograms[worst].counts[i];
+        }
+
+        clusters_build_lens(centers[k], max_code_len, lens[k]);
+
+        /// Only the new table can lower the bits of a segment, the others were taken into account already
+        for (size_t s = 0; s < n; s++) {
+            size_t bits = clusters_segment_bits(&histograms[s], lens + k, 1, max_code_len, NULL);
+            best_bits[s] = bits < best_bits[s] ? bits : best_bits[s];
+        }
+
+        k += 1;
+    }
+
+    /// K-means, where the distance is the number of bits of a segment coded with the table of a center.
+    /// Every round ends with the assignment refined to the current tables.
+    for (size_t round = 0; !got_error(); round++) {
+        clusters_refine(histograms, n, centers, lens, &k, max_code_len, assignment);
+        if (round + 1 == CLUSTER_MAX_ROUNDS || k == 1) break;
+
+        /// Bits that the segments of every table would cost more with the best of the other tables
+        size_t extra[HUFFMAN_MAX_TABLES] = {0};
+
+        for (size_t s = 0; s < n; s++) {
+            size_t t = assignment[s];
+            size_t current = clusters_segment_bits(&histograms[s], lens + t, 1, max_code_len, NULL);
+            size_t best = (size_t)-1;
+
+            for (size_t o = 0; o < k; o++) {
+                if (o == t) continue;
+
+                size_t bits = clusters_segment_bits(&histograms[s], lens + o, 1, max_code_len, NULL);
+                best = bits < best ? bits : best;
+            }
+
+            /// Refining may stop with the tables rebuilt after the last assignment, when another table can be better
+            if (best > current) {
+                extra[t] += best - current;
+            }
+        }
+
+        /// Every table that saves less than its own size is dropped at once, its segments are spread over the others.
+        /// The most profitable one is kept even then, so that there is always a table.
+        size_t m = 0;
+        size_t kept = 0;
+        long long kept_gain = LLONG_MIN;
+
+        for (size_t t = 0; t < k; t++) {
+            Symbols symbols;
+            symbols_from_frequencies(&symbols, centers[t]);
+            symbols_build_code_len(&symbols, max_code_len);
+            long long gain = (long long)extra[t] - (long long)symbols_compact_bit_len(&symbols);
+
+            if (gain > kept_gain) {
+                kept = t;
+                kept_gain = gain;
+            }
+
+            if (gain < 0) continue;
+
+            memmove(centers[m], centers[t], sizeof(centers[0]));
+            memmove(lens[m], lens[t], sizeof(lens[0]));
+            m += 1;
+        }
+
+        if (m == k) break;
+
+        if (!m) {
+            memmove(centers[0], centers[kept], sizeof(centers[0]));
+            memmove(lens[0], lens[kept], sizeof(lens[0]));
+            m = 1;
+        }
+
+        k = m;
+    }
+
+    /// A segment joins the run before it unless its own table saves more than the header of a new run
+    for (size_t s = 1; s < n && !got_error(); s++) {
+        size_t previous = assignment[s - 1];
+        if (assignment[s] == previous) continue;
+
+        size_t current_bits = clusters_segment_bits(&histograms[s], lens + assignment[s], 1, max_code_len, NULL);
+        size_t previous_bits = clusters_segment_bits(&histograms[s], lens + previous, 1, max_code_len, NULL);
+
+        if (previous_bits < current_bits + run_len_bits(input->items[s].len) + table_index_bits(k)) {
+            assignment[s] = previous;
+        }
+    }
+
+    if (!got_error()) {
+        clusters_update(histograms, n, centers, lens, &k, max_code_len, assignment);
+    }
+
+    if (!got_error()) {
+        *tables = malloc(k * sizeof(Symbols));
+        if (!*tables) set_error(Error_OutOfMemory);
+    }
+
+    for (size_t t = 0; t < k && !got_error(); t++) {
+        symbols_from_frequencies(&(*tables)[t], centers[t]);
+        symbols_build_code_len(&(*tables)[t], max_code_len);
+    }
+
+    /// Consecutive segments with the same table share one run
+    for (size_t s = 0; s < n && !got_error(); s++) {
+        BlockRun *last = *nof_runs ? &(*runs)[*nof_runs - 1] : NULL;
+
+        if (last && last->table == assignment[s]) {
+            last->nof_segments += 1;
+            last->len += input->items[s].len;
+            continue;
+        }
+
+        BlockRun run = { .segment = s, .nof_segments = 1, .len = input->items[s].len, .table = assignment[s] };
+        (*runs)[(*nof_runs)++] = run;
+    }
+
+    *nof_tables = k;
+
+    free(histograms);
+    free(centers);
+    free(lens);
+    free(own_bits);
+    free(best_bits);
+    free(assignment);
+}
+
+void clusters_refine(SparseHistogram *histograms, size_t n, Frequency (*centers)[ALPHABET_LEN], uint8_t (*lens)[ALPHABET_LEN], size_t *k, size_t max_code_len, size_t *assignment) {
+    for (size_t iteration = 0; iteration < CLUSTER_MAX_ITERATIONS; iteration++) {
+        bool is_changed = false;
+
+        for (size_t s = 0; s < n; s++) {
+            size_t best = 0;
+            clusters_segment_bits(&histograms[s], lens, *k, max_code_len, &best);
+
+            is_changed |= !iteration || assignment[s] != best;
+            assignment[s] = best;
+        }
+
+        if (!is_changed) break;
+
+        clusters_update(histograms, n, centers, lens, k, max_code_len, assignment);
+    }
+}
+
+void clusters_update(SparseHistogram *histograms, size_t n, Frequency (*centers)[ALPHABET_LEN], uint8_t (*lens)[ALPHABET_LEN], size_t *k, size_t max_code_len, size_t *assignment) {
+    /// Every center becomes the sum of its segments, so its table covers all of their symbols
+    memset(centers, 0, *k * sizeof(centers[0]));
+    for (size_t s = 0; s < n; s++) {
+        for (size_t i = 0; i < histograms[s].size; i++) {
+            centers[assignment[s]][histograms[s].symbols[i]] += histograms[s].counts[i];
+        }
+    }
+
+    /// Empty clusters are removed, the assignment is renumbered to the remaining ones
+    size_t remap[HUFFMAN_MAX_TABLES];
+    size_t m = 0;
+
+    for (size_t t = 0; t < *k; t++) {
+        bool is_used = false;
+        for (size_t c = 0; c < ALPHABET_LEN && !is_used; c++) {
+            is_used = centers[t][c] != 0;
+        }
+
+        /// The last cluster is kept even without any data, so that there is always a table
+        if (!is_used && !(t + 1 == *k && !m)) continue;
+
+        remap[t] = m;
+        if (m != t) {
+            memcpy(centers[m], centers[t], sizeof(centers[0]));
+        }
+
+        clusters_build_lens(centers[m], max_code_len, lens[m]);
+        m += 1;
+    }
+
+    for (size_t s = 0; s < n; s++) {
+        assignment[s] = remap[assignment[s]];
+    }
+
+    *k = m;
+}
+
+size_t clusters_segment_bits(SparseHistogram *histogram, uint8_t (*lens)[ALPHABET_LEN], size_t k, size_t max_code_len, size_t *best) {
+    size_t min_bits = (size_t)-1;
+
+    for (size_t t = 0; t < k; t++) {
+        size_t bits = 0;
+
+        /// A symbol missing from the table would get one of the longest codes
+        for (size_t i = 0; i < histogram->size; i++) {
+            uint8_t len = lens[t][histogram->symbols[i]];
+            bits += histogram->counts[i] * (len ? len : max_code_len);
+        }
+
+        if (bits < min_bits) {
+            min_bits = bits;
+            if (best) *best = t;
+        }
+    }
+
+    return min_bits;
+}
+
+void clusters_build_lens(Frequency histogram[ALPHABET_LEN], size_t max_code_len, uint8_t lens[ALPHABET_LEN]) {
+    Symbols symbols;
+    symbols_from_frequencies(&symbols, histogram);
+    symbols_build_code_len(&symbols, max_code_len);
+
+    memset(lens, 0, ALPHABET_LEN);
+    for (size_t i = 0; i < symbols.size; i++) {
+        lens[symbols.data[i].character] = symbols.data[i].code.len;
+    }
+}
+
+size_t run_len_bits(size_t len) {
+    size_t width = 0;
+
+    while (width < 63 && len >> width) {
+        width += 1;
+    }
+
+    return RUN_LEN_WIDTH_BITS + width;
+}
+
+size_t table_index_bits(size_t nof_tables) {
+    size_t bits = 0;
+
+    while (((size_t)1 << bits) < nof_tables) {
+        bits += 1;
+    }
+
+    return bits;
+}
+
+void huffman_plan_contexts(SegmentList *input, size_t max_code_len, size_t max_contexts, Symbols **tables, size_t *nof_contexts) {
+    Frequency freq[HUFFMAN_MAX_CONTEXTS][ALPHABET_LEN] = {0};
+    uint8_t contexts[HISTOGRAM_LEN];
+    uint8_t previous = 0;
+    *nof_contexts = 0;
+    *tables = malloc(HUFFMAN_MAX_CONTEXTS * sizeof(Symbols));
+
+    if (!*tables) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    contexts_map(contexts, HUFFMAN_MAX_CONTEXTS);
+
+    for (size_t s = 0; s < input->size; s++) {
+        uint8_t *bytes = input->items[s].data;
+
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            freq[contexts[previous]][bytes[i]] += 1;
+            previous = bytes[i];
+        }
+    }
+
+    /// Fewer contexts merge the widest magnitudes, a single one is the plain format
+    size_t best_bits = contexts_build(freq, 1, max_code_len, *tables);
+
+    for (size_t n = 2; n <= max_contexts && !got_error(); n++) {
+        size_t nof_bits = contexts_build(freq, n, max_code_len, *tables) + 8;
+
+        if (nof_bits < best_bits) {
+            best_bits = nof_bits;
+            *nof_contexts = n;
+        }
+    }
+
+    if (*nof_contexts && !got_error()) {
+        contexts_build(freq, *nof_contexts, max_code_len, *tables);
+    }
+
+    if (!*nof_contexts || got_error()) {
+        free(*tables);
+        *tables = NULL;
+        *nof_contexts = 0;
+    }
+}
+
+size_t contexts_build(Frequency (*freq)[ALPHABET_LEN], size_t nof_contexts, size_t max_code_len, Symbols *tables) {
+    size_t nof_bits = 0;
+
+    for (size_t c = 0; c < nof_contexts && !got_error(); c++) {
+        Frequency merged[ALPHABET_LEN];
+        memcpy(merged, freq[c], sizeof(merged));
+
+        /// The last context takes all the wider ones
+        if (c + 1 == nof_contexts) {
+            for (size_t w = nof_contexts; w < HUFFMAN_MAX_CONTEXTS; w++) {
+                for (size_t i = 0; i < ALPHABET_LEN; i++) {
+                    merged[i] += freq[w][i];
+                }
+            }
+        }
+
+        symbols_from_frequencies(&tables[c], merged);
+        symbols_build_code_len(&tables[c], max_code_len);
+        nof_bits += symbols_encoded_bit_len(&tables[c]) + symbols_compact_bit_len(&tables[c]);
+    }
+
+    return nof_bits;
+}
+
+void contexts_map(uint8_t contexts[HISTOGRAM_LEN], size_t nof_contexts) {
+    /// Bit width of the byte taken as a signed value, 0 for a zero up to 8 for -128
+    for (size_t byte = 0; byte < HISTOGRAM_LEN; byte++) {
+        size_t magnitude = byte < 128 ? byte : 256 - byte;
+        size_t width = 0;
+
+        while (magnitude >> width) {
+            width += 1;
+        }
+
+        contexts[byte] = width < nof_contexts ? width : nof_contexts - 1;
+    }
+}
+
+void huffman_encode_contexts(SegmentList *input, Symbols *tables, size_t nof_contexts, BitArray *output) {
+    /// The first table is stored as the shared one, the others follow their count
+    CodeBook reversed[HUFFMAN_MAX_CONTEXTS];
+    uint8_t contexts[HISTOGRAM_LEN];
+    size_t nof_bits = 0;
+
+    bit_array_push_n(output, nof_contexts - 1, 8);
+
+    for (size_t c = 0; c < nof_contexts && !got_error(); c++) {
+        CodeBook codebook;
+
+        if (c) symbols_encode_compact(&tables[c], output);
+        symbols_to_codebook(&tables[c], codebook);
+        codebook_reverse(codebook, reversed[c]);
+        nof_bits += symbols_encoded_bit_len(&tables[c]);
+    }
+
+    if (got_error()) return;
+
+    BitWriter writer = bit_writer_new(output, nof_bits);
+    if (got_error()) return;
+
+    contexts_map(contexts, nof_contexts);
+    uint8_t previous = 0;
+
+    for (size_t s = 0; s < input->size; s++) {
+        uint8_t *bytes = input->items[s].data;
+
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            Code code = reversed[contexts[previous]][bytes[i]];
+            bit_writer_push(&writer, code.code, code.len);
+            previous = bytes[i];
+        }
+    }
+
+    bit_writer_finish(&writer);
+}
+
+void huffman_decode_contexts(DecodeTable *table, BitArray *input, size_t len, BitArray *output) {
+    DecodeTable tables[HUFFMAN_MAX_CONTEXTS] = {0};
+    uint8_t contexts[HISTOGRAM_LEN];
+    size_t nof_contexts = bit_array_read_n(input, 8) + 1;
+    if (got_error()) return;
+
+    if (nof_contexts < 2 || nof_contexts > HUFFMAN_MAX_CONTEXTS) {
+        fprintf(stderr, "ERR huffman_decode_contexts: Invalid number of contexts %ld\n", nof_contexts);
+        set_error(Error_InvalidFormat);
+        return;
+    }
+
+    tables[0] = *table;
+    for (size_t c = 1; c < nof_contexts && !got_error(); c++) {
+        Symbols symbols;
+        symbols_decode_compact(&symbols, false, input);
+        if (!got_error()) decode_table_build(&tables[c], &symbols);
+    }
+
+    if (!got_error()) bit_array_reserve(output, len);
+
+    BitReader reader = {0};
+    if (!got_error()) reader = bit_reader_new(input);
+
+    contexts_map(contexts, nof_contexts);
+    uint8_t previous = 0;
+
+    /// A context without any symbol has no code at all, so a broken stream fails its lookup
+    for (size_t i = 0; i < len && !got_error(); i++) {
+        uint8_t byte = decode_table_read_next(&tables[contexts[previous]], &reader);
+        output->data[i] = byte;
+        previous = byte;
+    }
+
+    if (!got_error()) {
+        huffman_expect_eof(table, &reader);
+    }
+
+    if (!got_error()) {
+        output->len = len * 8;
+    }
+
+    for (size_t c = 1; c < nof_contexts; c++) {
+        decode_table_free(&tables[c]);
+    }
+}
+
+void huffman_plan_pairs(SegmentList *input, size_t max_code_len, Symbols *symbols, PairDictionary *dictionary) {
+    Frequency *freq = calloc(PAIR_ALPHABET_LEN, sizeof(Frequency));
+    PairCount *order = malloc(PAIR_ALPHABET_LEN * sizeof(PairCount));
+    Frequency byte_freq[ALPHABET_LEN] = {0};
+    memset(dictionary, 0, sizeof(PairDictionary));
+
+    if (!freq || !order) {
+        set_error(Error_OutOfMemory);
+        free(freq);
+        free(order);
+        return;
+    }
+
+    /// Pairs may cross the boundary of two segments
+    int first = -1;
+    for (size_t s = 0; s < input->size; s++) {
+        uint8_t *bytes = input->items[s].data;
+
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            byte_freq[bytes[i]] += 1;
+
+            if (first < 0) {
+                first = bytes[i];
+            } else {
+                freq[first | bytes[i] << 8] += 1;
+                first = -1;
+            }
+        }
+    }
+
+    size_t nof_distinct = 0;
+    for (size_t pair = 0; pair < PAIR_ALPHABET_LEN; pair++) {
+        if (freq[pair]) order[nof_distinct++] = (PairCount){ .pair = pair, .frequency = freq[pair] };
+    }
+
+    /// The most frequent pairs come first, so their code lengths form the runs of the compact table
+    qsort(order, nof_distinct, sizeof(PairCount), pairs_compare);
+
+    Frequency freq_by_index[ALPHABET_LEN] = {0};
+    dictionary->size = nof_distinct <= HISTOGRAM_LEN ? nof_distinct : HISTOGRAM_LEN - 1;
+    dictionary->has_escape = nof_distinct > dictionary->size;
+
+    for (size_t i = 0; i < nof_distinct; i++) {
+        if (i < dictionary->size) {
+            dictionary->pairs[i][0] = order[i].pair & 0xFF;
+            dictionary->pairs[i][1] = order[i].pair >> 8;
+            freq_by_index[i] = order[i].frequency;
+        } else {
+            freq_by_index[dictionary->size] += order[i].frequency;
+        }
+    }
+
+    dictionary->nof_escapes = dictionary->has_escape ? freq_by_index[dictionary->size] : 0;
+    free(freq);
+    free(order);
+
+    /// Pairs only pay off when their codes save more than the dictionary costs
+    Symbols bytes;
+    symbols_from_frequencies(&bytes, byte_freq);
+    symbols_build_code_len(&bytes, max_code_len);
+    symbols_from_frequencies(symbols, freq_by_index);
+    symbols_build_code_len(symbols, max_code_len);
+    if (got_error()) return;
+
+    size_t byte_bits = symbols_encoded_bit_len(&bytes) + symbols_compact_bit_len(&bytes);
+    size_t pair_bits = symbols_encoded_bit_len(symbols) + symbols_compact_bit_len(symbols) + 9 + 16 * dictionary->size + pairs_raw_bit_len(dictionary, segment_list_byte_len(input));
+
+    if (!dictionary->size || pair_bits >= byte_bits) {
+        dictionary->size = 0;
+        *symbols = bytes;
+    }
+}
+
+int pairs_compare(const void *a, const void *b) {
+    const PairCount *pair_a = a;
+    const PairCount *pair_b = b;
+
+    if (pair_a->frequency != pair_b->frequency) {
+        return pair_a->frequency < pair_b->frequency ? 1 : -1;
+    }
+
+    return (int)pair_a->pair - (int)pair_b->pair;
+}
+
+size_t pairs_raw_bit_len(PairDictionary *dictionary, size_t len) {
+    /// The escaped pairs and the last byte of an odd length are stored among the codes as they are
+    return 16 * dictionary->nof_escapes + (len % 2) * 8;
+}
+
+void huffman_encode_pairs(SegmentList *input, CodeBook codebook, PairDictionary *dictionary, size_t nof_bits, BitArray *output) {
+    /// Every pair outside of the dictionary maps to the escape symbol
+    uint16_t *indices = malloc(PAIR_ALPHABET_LEN * sizeof(uint16_t));
+    if (!indices) {
+        set_error(Error_OutOfMemory);
+        return;
+    }
+
+    for (size_t pair = 0; pair < PAIR_ALPHABET_LEN; pair++) {
+        indices[pair] = dictionary->size;
+    }
+
+    bit_array_push_n(output, dictionary->size - 1, 8);
+    bit_array_push_n(output, dictionary->has_escape, 1);
 
-typedef struct {
-    Node data[ALPHABET_LEN]; ///< No need for dynamic allocation here since maximum number of node will always be the alphabet length.
-    size_t size;
-} AlphabetMinHeap;
+    for (size_t i = 0; i < dictionary->size; i++) {
+        indices[dictionary->pairs[i][0] | dictionary->pairs[i][1] << 8] = i;
+        bit_array_push_n(output, dictionary->pairs[i][0], 8);
+        bit_array_push_n(output, dictionary->pairs[i][1], 8);
+    }
 
-typedef struct node {
-    uint16_t value; ///< ALPHABET_LEN == NULL
-    struct node *left;
-    struct node *right;
-} HuffmanNode;
+    CodeBook reversed;
+    codebook_reverse(codebook, reversed);
 
-void symbols_from_bytes(Symbols *symbols, uint8_t *bytes, size_t len);
-void symbols_push(Symbols *symbols, Symbol symbol);
-void symbols_to_codebook(Symbols *symbols, CodeBook codebook);
-void symbols_calc_code(Symbols *symbols);
-void symbols_calc_code_len(Symbols *symbols);
-void symbols_sort(Symbols *symbols);
-void symbols_encode(Symbols *symbols, BitArray *output);
-void symbols_decode(Symbols *symbols, BitArray *input);
+    BitWriter writer = bit_writer_new(output, nof_bits);
+    if (got_error()) {
+        free(indices);
+        return;
+    }
 
-void alphabet_min_heap_push(AlphabetMinHeap *heap, Frequency freq, size_t m);
-Node alphabet_min_heap_pop(AlphabetMinHeap *heap);
+    int first = -1;
+    for (size_t s = 0; s < input->size; s++) {
+        uint8_t *bytes = input->items[s].data;
 
-HuffmanNode *huffman_node_new();
-void huffman_node_free(HuffmanNode *root);
-void huffman_node_insert(HuffmanNode *root, Symbol *symbol);
-uint16_t huffman_node_read_next(HuffmanNode *root, BitArray *input);
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            if (first < 0) {
+                first = bytes[i];
+                continue;
+            }
 
-HuffmanNode *build_huffman_tree(Symbols *symbols);
+            uint16_t pair = first | bytes[i] << 8;
+            Code code = reversed[indices[pair]];
+            bit_writer_push(&writer, code.code, code.len);
 
-void bit_array_push_code(BitArray *arr, Code code);
+            if (indices[pair] == dictionary->size) {
+                bit_writer_push(&writer, pair, 16);
+            }
 
-BitArray huffman_compress(uint8_t *bytes, size_t len) {
-    #define COMPRESS_ERROR_GUARD(func) func; \
-        if ( got_error()) { \
-            bit_array_free(&result); \
-            return result; \
+            first = -1;
         }
+    }
 
-    BitArray result = bit_array_new(NULL, 0);
+    /// The last byte of an odd length is left without a pair
+    if (first >= 0) {
+        bit_writer_push(&writer, first, 8);
+    }
 
-    log("Creating list of symbols");
-    Symbols symbols;
-    symbols_from_bytes(&symbols, bytes, len);
-    log("Calculate code len of symbols");
-    symbols_calc_code_len(&symbols);
+    bit_writer_finish(&writer);
+    free(indices);
+}
 
-    log("Make codebook out of symbols");
-    /// Code book
-    CodeBook codebook;
-    symbols_to_codebook(&symbols, codebook);
+void huffman_decode_pairs(DecodeTable *table, BitArray *input, HuffmanDecodeMode mode, size_t len, BitArray *output) {
+    PairDictionary dictionary = {0};
+    dictionary.size = bit_array_read_n(input, 8) + 1;
+    dictionary.has_escape = bit_array_read_n(input, 1);
+    if (got_error()) return;
 
-    log("Encoding codebook into the output");
-    COMPRESS_ERROR_GUARD(symbols_encode(&symbols, &result));
+    if (dictionary.has_escape && dictionary.size == HISTOGRAM_LEN) {
+        fprintf(stderr, "ERR huffman_decode_pairs: No symbol is left for the escape\n");
+        set_error(Error_InvalidFormat);
+        return;
+    }
 
-    int count = 0;
-    log("Encoding the huffman coding into the output");
-    /// Encode
-    for (size_t i = 0; i < len; i++) {
-        Code code = codebook[bytes[i]];
-        logfmt("Pushing char %d as %ld with length %d", bytes[i], code.code, code.len);
-        COMPRESS_ERROR_GUARD(bit_array_push_code(&result, code));
-        count += 1;
+    for (size_t i = 0; i < dictionary.size; i++) {
+        dictionary.pairs[i][0] = bit_array_read_n(input, 8);
+        dictionary.pairs[i][1] = bit_array_read_n(input, 8);
     }
 
-    Code eof = codebook[ALPHABET_LEN-1];
-    logfmt("Pushing EOF as %ld with length %d", eof.code, eof.len);
-    COMPRESS_ERROR_GUARD(bit_array_push_code(&result, eof));
+    bit_array_reserve(output, len);
+    if (got_error()) return;
 
-    logfmt("Compressed to %ld bytes", bit_array_byte_len(&result));
+    BitReader reader = bit_reader_new(input);
+    if (got_error()) return;
 
-    return result;
-}
+    MultiDecodeTable multi;
+    if (mode == HuffmanDecodeMode_Multi) {
+        log("Building multi-symbol decode table of pairs");
+        pairs_multi_decode_table_build(multi, table, &dictionary);
+    }
 
-BitArray huffman_decompress(uint8_t *bytes, size_t len) {
-    #define DECOMPRESS_ERROR_GUARD(on_error) \
-        if ( got_error()) { \
-            on_error; \
-            bit_array_free(&input); \
-            bit_array_free(&result); \
-            return result; \
+    size_t nof_symbols = dictionary.size + dictionary.has_escape;
+    size_t pairs_len = len - len % 2;
+    size_t i = 0;
+
+    while (i < pairs_len) {
+        /// Two pairs per lookup as long as they cannot run past the end
+        if (mode == HuffmanDecodeMode_Multi && i + MULTI_DECODE_MAX_SYMBOLS <= pairs_len) {
+            MultiDecodeEntry entry = multi[bit_reader_peek(&reader, DECODE_TABLE_BITS)];
+
+            if (entry.count) {
+                bit_reader_consume(&reader, entry.len);
+                memcpy(output->data + i, entry.symbols, MULTI_DECODE_MAX_SYMBOLS);
+                i += entry.count;
+                continue;
+            }
         }
 
-    BitArray input = bit_array_new(bytes, len);
-    BitArray result = bit_array_new(NULL, 0);
-
-    log("Decoding symbol list");
-    Symbols symbols;
-    symbols_decode(&symbols, &input);
-    DECOMPRESS_ERROR_GUARD();
-
-    log("Building huffman tree");
-    HuffmanNode *root = build_huffman_tree(&symbols);
-    DECOMPRESS_ERROR_GUARD();
+        uint16_t index = decode_table_read_next(table, &reader);
+        if (got_error()) return;
 
-    uint16_t byte;
+        if (index >= nof_symbols) {
+            fprintf(stderr, "ERR huffman_decode_pairs: Symbol %d is out of the dictionary\n", index);
+            set_error(Error_InvalidFormat);
+            return;
+        }
 
-    int count = 0;
-    log("Decompressing");
-    while ((byte = huffman_node_read_next(root, &input)) != EOF_BYTE) {
-        if (got_error()) {
-            break;
+        if (index == dictionary.size) {
+            output->data[i] = bit_reader_read(&reader, 8);
+            output->data[i + 1] = bit_reader_read(&reader, 8);
+            if (got_error()) return;
+        } else {
+            output->data[i] = dictionary.pairs[index][0];
+            output->data[i + 1] = dictionary.pairs[index][1];
         }
 
-        logfmt("Decompressed 0x%02X", byte);
+        i += 2;
+    }
 
-        bit_array_push_n(&result, byte, 8);
-        DECOMPRESS_ERROR_GUARD(huffman_node_free(root));
-        count += 1;
+    if (len % 2) {
+        output->data[pairs_len] = bit_reader_read(&reader, 8);
     }
 
-    bit_array_free(&input);
-    huffman_node_free(root);
+    if (!got_error()) {
+        huffman_expect_eof(table, &reader);
+    }
 
-    return result;
+    if (!got_error()) {
+        output->len = len * 8;
+    }
 }
 
-void symbols_from_bytes(Symbols *symbols, uint8_t *bytes, size_t len) {
-    memset(symbols, 0, sizeof(Symbols));
+void pairs_multi_decode_table_build(MultiDecodeTable multi, DecodeTable *table, PairDictionary *dictionary) {
+    for (size_t index = 0; index < DECODE_TABLE_SIZE; index++) {
+        MultiDecodeEntry *entry = &multi[index];
+        entry->count = 0;
+        entry->len = 0;
 
-    Frequency freq[ALPHABET_LEN] = {0};
-    freq[ALPHABET_LEN - 1] = 1; // EOF
+        /// Same as `multi_decode_table_build`, but every code yields two bytes and the escape ends the chain
+        while (entry->count < MULTI_DECODE_MAX_SYMBOLS) {
+            DecodeEntry next = table->entries[(index >> entry->len) & (DECODE_TABLE_SIZE - 1)];
 
-    for (size_t i = 0; i < len; i++) {
-        freq[bytes[i]] += 1;
+            if (next.link || !next.len || next.value >= dictionary->size || entry->len + next.len > DECODE_TABLE_BITS) {
+                break;
+            }
+
+            memcpy(entry->symbols + entry->count, dictionary->pairs[next.value], 2);
+            entry->count += 2;
+            entry->len += next.len;
+        }
     }
+}
+
+void symbols_from_segments(Symbols *symbols, SegmentList *input, bool has_eof) {
+    Frequency freq[ALPHABET_LEN] = {0};
+    freq[ALPHABET_LEN - 1] = has_eof; // EOF
+
+    histogram_count_segments(freq, input);
+
+    symbols_from_frequencies(symbols, freq);
+}
+
+void symbols_from_frequencies(Symbols *symbols, Frequency freq[ALPHABET_LEN]) {
+    memset(symbols, 0, sizeof(Symbols));
 
     for (int i = 0; i < ALPHABET_LEN; i++) {
         if (!freq[i]) {
@@ -182,6 +2532,25 @@ void symbols_from_bytes(Symbols *symbols, uint8_t *bytes, size_t len) {
     }
 }
 
+void symbols_build_code_len(Symbols *symbols, size_t max_code_len) {
+    symbols_calc_code_len(symbols);
+
+    /// Plain Huffman is optimal whenever it already fits into the limit
+    if (symbols_max_code_len(symbols) > max_code_len) {
+        symbols_calc_code_len_limited(symbols, max_code_len);
+    }
+}
+
+size_t symbols_compact_bit_len(Symbols *symbols) {
+    BitArray table = bit_array_new(NULL, 0);
+    symbols_encode_compact(symbols, &table);
+
+    size_t len = table.len;
+    bit_array_free(&table);
+
+    return len;
+}
+
 void symbols_push(Symbols *symbols, Symbol symbol) {
     symbols->data[symbols->size++] = symbol;
 }
@@ -196,6 +2565,24 @@ void symbols_to_codebook(Symbols *symbols, CodeBook codebook) {
     }
 }
 
+size_t symbols_encoded_bit_len(Symbols *symbols) {
+    size_t nof_bits = 0;
+
+    for (size_t i = 0; i < symbols->size; i++) {
+        nof_bits += symbols->data[i].frequency * symbols->data[i].code.len;
+    }
+
+    return nof_bits;
+}
+
+void codebook_reverse(CodeBook codebook, CodeBook reversed) {
+    /// Codes are written MSB first into the LSB first bit array
+    for (size_t i = 0; i < ALPHABET_LEN; i++) {
+        reversed[i].code = reverse_bits(codebook[i].code, codebook[i].len);
+        reversed[i].len = codebook[i].len;
+    }
+}
+
 void symbols_calc_code(Symbols *symbols) {
     symbols_sort(symbols);
 
@@ -254,6 +2641,116 @@ void symbols_calc_code_len(Symbols *symbols) {
     }
 }
 
+/// Package-merge, optimal code lengths under the constraint of `max_len`
+void symbols_calc_code_len_limited(Symbols *symbols, size_t max_len) {
+    logfmt("Calculating code len limited to %ld bits", max_len);
+    size_t n = symbols->size;
+
+    if (n > ((uint64_t)1 << max_len)) {
+        fprintf(stderr, "ERR symbols_calc_code_len_limited: %ld symbols cannot fit into %ld bits\n", n, max_len);
+        set_error(Error_InvalidArgument);
+        return;
+    }
+
+    if (n <= 2) {
+        for (size_t i = 0; i < n; i++) {
+            symbols->data[i].code.len = 1;
+        }
+        return;
+    }
+
+    /// Leaves in the ascending order of their frequency
+    PackageItem leaves[ALPHABET_LEN];
+    for (size_t i = 0; i < n; i++) {
+        PackageItem item = { .weight = symbols->data[i].frequency, .symbol = i };
+        size_t j = i;
+
+        while (j > 0 && leaves[j - 1].weight > item.weight) {
+            leaves[j] = leaves[j - 1];
+            j -= 1;
+        }
+
+        leaves[j] = item;
+    }
+
+    /// Every level is the merge of the leaves and the packages of the level below,
+    /// only the item kinds are kept for the backtracking
+    uint16_t levels[HUFFMAN_MAX_CODE_LEN][ALPHABET_LEN * 2];
+    size_t level_size[HUFFMAN_MAX_CODE_LEN];
+    PackageItem current[ALPHABET_LEN * 2];
+    PackageItem next[ALPHABET_LEN * 2];
+    size_t current_size = n;
+
+    memcpy(current, leaves, n * sizeof(PackageItem));
+
+    for (size_t level = 0; level < max_len; level++) {
+        for (size_t i = 0; i < current_size; i++) {
+            levels[level][i] = current[i].symbol;
+        }
+        level_size[level] = current_size;
+
+        if (level + 1 == max_len) break;
+
+        /// Merge the leaves with the pairs of the current level
+        size_t nof_packages = current_size / 2;
+        size_t leaf = 0, package = 0, size = 0;
+
+        while (leaf < n || package < nof_packages) {
+            Frequency package_weight = 0;
+            if (package < nof_packages) {
+                package_weight = current[package * 2].weight + current[package * 2 + 1].weight;
+            }
+
+            if (package >= nof_packages || (leaf < n && leaves[leaf].weight <= package_weight)) {
+                next[size++] = leaves[leaf++];
+            } else {
+                next[size].weight = package_weight;
+                next[size++].symbol = PACKAGE_ITEM;
+                package += 1;
+            }
+        }
+
+        memcpy(current, next, size * sizeof(PackageItem));
+        current_size = size;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        symbols->data[i].code.len = 0;
+    }
+
+    /// The 2n - 2 cheapest items of the top level, each package unfolds into the first items of the level below
+    size_t take = 2 * n - 2;
+    for (size_t level = max_len; level-- > 0 && take;) {
+        size_t nof_packages = 0;
+
+        for (size_t i = 0; i < take && i < level_size[level]; i++) {
+            if (levels[level][i] == PACKAGE_ITEM) {
+                nof_packages += 1;
+            } else {
+                symbols->data[levels[level][i]].code.len += 1;
+            }
+        }
+
+        take = nof_packages * 2;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        logfmt("Symbol %d has limited code length of %d", symbols->data[i].character, symbols->data[i].code.len);
+    }
+}
+
+size_t symbols_max_code_len(Symbols *symbols) {
+    size_t max = 0;
+
+    for (size_t i = 0; i < symbols->size; i++) {
+        if (symbols->data[i].code.len > max) {
+            max = symbols->data[i].code.len;
+        }
+    }
+
+    return max;
+}
+
 /// Perform insertion sort
 void symbols_sort(Symbols *symbols) {
     for (size_t i = 1; i < symbols->size; i++) {
@@ -310,6 +2807,178 @@ void heapify_down(AlphabetMinHeap *heap, size_t index) {
     }
 }
 
+/// Order of the stored code-length code lengths, the rarely used ones come last and are cut off
+static const uint8_t CL_ORDER[CL_ALPHABET_LEN] = {
+    CL_ZEROS, CL_ZEROS_LONG, CL_REPEAT, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+};
+
+size_t symbols_run_len(uint8_t *lens, size_t i, size_t max) {
+    size_t n = 0;
+
+    while (i + n < ALPHABET_LEN && lens[i + n] == lens[i] && n < max) {
+        n += 1;
+    }
+
+    return n;
+}
+
+void symbols_encode_compact(Symbols *symbols, BitArray *output) {
+    uint8_t lens[ALPHABET_LEN] = {0};
+    for (size_t i = 0; i < symbols->size; i++) {
+        lens[symbols->data[i].character] = symbols->data[i].code.len;
+    }
+
+    /// Run-length coded lengths, in the spirit of the code-length alphabet of DEFLATE
+    uint8_t items[ALPHABET_LEN];
+    uint8_t extra[ALPHABET_LEN];
+    size_t nof_items = 0;
+    Frequency freq[CL_ALPHABET_LEN] = {0};
+
+    for (size_t i = 0; i < ALPHABET_LEN;) {
+        size_t run = symbols_run_len(lens, i, 138);
+
+        if (!lens[i] && run >= 11) {
+            items[nof_items] = CL_ZEROS_LONG;
+            extra[nof_items] = run - 11;
+        } else if (!lens[i] && run >= 3) {
+            items[nof_items] = CL_ZEROS;
+            extra[nof_items] = run - 3;
+        } else if (i && lens[i] && lens[i] == lens[i - 1] && run >= 3) {
+            run = run > 6 ? 6 : run;
+            items[nof_items] = CL_REPEAT;
+            extra[nof_items] = run - 3;
+        } else {
+            run = 1;
+            items[nof_items] = lens[i];
+        }
+
+        freq[items[nof_items++]] += 1;
+        i += run;
+    }
+
+    Symbols cl = {0};
+    for (size_t i = 0; i < CL_ALPHABET_LEN; i++) {
+        if (freq[i]) {
+            Symbol symbol = { .character = i, .frequency = freq[i] };
+            symbols_push(&cl, symbol);
+        }
+    }
+
+    symbols_calc_code_len(&cl);
+    if (symbols_max_code_len(&cl) > CL_MAX_CODE_LEN) {
+        symbols_calc_code_len_limited(&cl, CL_MAX_CODE_LEN);
+        if (got_error()) return;
+    }
+
+    CodeBook codebook;
+    symbols_to_codebook(&cl, codebook);
+
+    size_t nof_cl = CL_ALPHABET_LEN;
+    while (nof_cl > 1 && !codebook[CL_ORDER[nof_cl - 1]].len) {
+        nof_cl -= 1;
+    }
+
+    bit_array_push_n(output, nof_cl - 1, 6);
+    for (size_t i = 0; i < nof_cl; i++) {
+        bit_array_push_n(output, codebook[CL_ORDER[i]].len, 3);
+    }
+
+    for (size_t i = 0; i < nof_items; i++) {
+        Code code = codebook[items[i]];
+        bit_array_push_n(output, reverse_bits(code.code, code.len), code.len);
+
+        switch (items[i]) {
+            case CL_REPEAT: bit_array_push_n(output, extra[i], 2); break;
+            case CL_ZEROS: bit_array_push_n(output, extra[i], 3); break;
+            case CL_ZEROS_LONG: bit_array_push_n(output, extra[i], 7); break;
+        }
+    }
+}
+
+void symbols_decode_compact(Symbols *symbols, bool has_eof, BitArray *input) {
+    memset(symbols, 0, sizeof(Symbols));
+
+    Symbols cl = {0};
+    uint8_t cl_lens[CL_ALPHABET_LEN] = {0};
+    size_t nof_cl = bit_array_read_n(input, 6) + 1;
+
+    if (nof_cl > CL_ALPHABET_LEN) {
+        fprintf(stderr, "ERR symbols_decode: Too many code-length codes\n");
+        set_error(Error_InvalidFormat);
+        return;
+    }
+
+    for (size_t i = 0; i < nof_cl && !got_error(); i++) {
+        cl_lens[CL_ORDER[i]] = bit_array_read_n(input, 3);
+    }
+
+    /// Pushed in the order of the alphabet, same as by the encoder
+    for (size_t i = 0; i < CL_ALPHABET_LEN; i++) {
+        if (cl_lens[i]) {
+            Symbol symbol = { .character = i, .code = { .len = cl_lens[i] } };
+            symbols_push(&cl, symbol);
+        }
+    }
+
+    if (got_error()) return;
+    if (!cl.size) {
+        fprintf(stderr, "ERR symbols_decode: Empty code-length code\n");
+        set_error(Error_InvalidFormat);
+        return;
+    }
+
+    symbols_calc_code(&cl);
+
+    DecodeTable table;
+    decode_table_build(&table, &cl);
+    if (got_error()) return;
+
+    BitReader reader = bit_reader_new(input);
+    uint8_t lens[ALPHABET_LEN] = {0};
+
+    for (size_t i = 0; i < ALPHABET_LEN && !got_error();) {
+        uint16_t item = decode_table_read_next(&table, &reader);
+        size_t run = 1;
+        if (got_error()) break;
+
+        switch (item) {
+            case CL_REPEAT: run = bit_reader_read(&reader, 2) + 3; break;
+            case CL_ZEROS: run = bit_reader_read(&reader, 3) + 3; break;
+            case CL_ZEROS_LONG: run = bit_reader_read(&reader, 7) + 11; break;
+        }
+
+        if (i + run > ALPHABET_LEN || (item == CL_REPEAT && !i)) {
+            fprintf(stderr, "ERR symbols_decode: Code lengths are out of the alphabet\n");
+            set_error(Error_InvalidFormat);
+            break;
+        }
+
+        uint8_t len = item == CL_REPEAT ? lens[i - 1] : item <= HUFFMAN_MAX_CODE_LEN ? item : 0;
+        memset(lens + i, len, run);
+        i += run;
+    }
+
+    decode_table_free(&table);
+    input->cursor = reader.cursor;
+    if (got_error()) return;
+
+    if (!lens[EOF_BYTE] != !has_eof) {
+        fprintf(stderr, "ERR symbols_decode: %s EOF\n", has_eof ? "Missing" : "Unexpected");
+        set_error(Error_InvalidFormat);
+        return;
+    }
+
+    for (size_t i = 0; i < ALPHABET_LEN; i++) {
+        if (lens[i]) {
+            Symbol symbol = { .character = i, .code = { .len = lens[i] } };
+            symbols_push(symbols, symbol);
+        }
+    }
+
+    symbols_calc_code(symbols);
+}
+
 void alphabet_min_heap_push(AlphabetMinHeap *heap, Frequency freq, size_t m) {
     if (heap->size >= ALPHABET_LEN) {
         // Heap is full
@@ -345,8 +3014,8 @@ Node alphabet_min_heap_pop(AlphabetMinHeap *heap) {
 }
 
 
-void symbols_encode(Symbols *symbols, BitArray *output) {
-    bit_array_push_n(output, symbols->size - 2, 8); // Not including EOF
+void symbols_encode(Symbols *symbols, bool has_eof, BitArray *output) {
+    bit_array_push_n(output, symbols->size - 1 - has_eof, 8); // Not including EOF
 
     uint8_t eof_code_len = 0;
     for (size_t i = 0; i < symbols->size; i++) {
@@ -361,10 +3030,12 @@ void symbols_encode(Symbols *symbols, BitArray *output) {
         bit_array_push_n(output, symbol.code.len - 1, 8); // -1 since 0 cannot be the code length
     }
 
-    bit_array_push_n(output, eof_code_len - 1, 8); // EOF be the last
+    if (has_eof) {
+        bit_array_push_n(output, eof_code_len - 1, 8); // EOF be the last
+    }
 }
 
-void symbols_decode(Symbols *symbols, BitArray *input) {
+void symbols_decode(Symbols *symbols, bool has_eof, BitArray *input) {
     memset(symbols, 0, sizeof(Symbols));
 
     uint16_t size = bit_array_read_n(input, 8) + 1;
@@ -378,117 +3049,177 @@ void symbols_decode(Symbols *symbols, BitArray *input) {
         symbol.code.len = bit_array_read_n(input, 8) + 1;
         if (got_error()) return;
 
+        if (symbol.code.len > HUFFMAN_MAX_CODE_LEN) {
+            fprintf(stderr, "ERR symbols_decode: Code length %d is over the limit\n", symbol.code.len);
+            set_error(Error_InvalidFormat);
+            return;
+        }
+
         symbols_push(symbols, symbol);
     }
 
+    if (!has_eof) {
+        symbols_calc_code(symbols);
+        return;
+    }
+
     Symbol eof = {0};
     eof.character = EOF_BYTE;
     eof.code.len = bit_array_read_n(input, 8) + 1;
     if (got_error()) return;
+
+    if (eof.code.len > HUFFMAN_MAX_CODE_LEN) {
+        fprintf(stderr, "ERR symbols_decode: Code length %d is over the limit\n", eof.code.len);
+        set_error(Error_InvalidFormat);
+        return;
+    }
     symbols_push(symbols, eof);
 
     symbols_calc_code(symbols);
 }
 
-HuffmanNode *huffman_node_new() {
-    HuffmanNode *node = malloc(sizeof(HuffmanNode));
+void decode_table_build(DecodeTable *table, Symbols *symbols) {
+    table->entries = NULL;
+    table->nof_subtables = 0;
+    table->has_eof = false;
 
-    if (!node) {
-        fprintf(stderr, "ERR huffman_node_new: Cannot allocate space for new node\n");
-        set_error(Error_OutOfMemory);
-        return NULL;
+    /// Upper bound of the sub-tables, each level below the primary table of a long code may need its own
+    size_t max_subtables = 0;
+    for (size_t i = 0; i < symbols->size; i++) {
+        size_t len = symbols->data[i].code.len;
+        if (len > DECODE_TABLE_BITS) {
+            max_subtables += (len - DECODE_TABLE_BITS + DECODE_SUBTABLE_BITS - 1) / DECODE_SUBTABLE_BITS;
+        }
     }
 
-    node->value = HUFFMAN_NULL_VAL;
-    node->left = NULL;
-    node->right = NULL;
-
-    return node;
-}
+    size_t nof_entries = DECODE_TABLE_SIZE + max_subtables * DECODE_SUBTABLE_SIZE;
+    table->entries = calloc(nof_entries, sizeof(DecodeEntry));
 
-void huffman_node_free(HuffmanNode *node) {
-    if (node) {
-        huffman_node_free(node->left);
-        huffman_node_free(node->right);
-        free(node);
+    if (!table->entries) {
+        fprintf(stderr, "ERR decode_table_build: Cannot allocate the decode table\n");
+        set_error(Error_OutOfMemory);
+        return;
     }
-}
-
-void huffman_node_insert(HuffmanNode *node, Symbol *symbol) {
-    uint64_t path = symbol->code.code;
-    uint16_t index = symbol->code.len - 1;
-    logfmt("huffman insert code %ld with %d", path, symbol->character);
 
-    for (int i = 0; i < symbol->code.len; i++) {
-        HuffmanNode **next = NULL;
-        if ((path >> index) & 1) {
-            next = &node->left;
-        } else {
-            next = &node->right;
+    for (size_t i = 0; i < symbols->size; i++) {
+        Symbol *symbol = &symbols->data[i];
+        uint64_t code = symbol->code.code;
+        size_t len = symbol->code.len;
+        size_t consumed = 0;
+        size_t table_bits = DECODE_TABLE_BITS;
+        DecodeEntry *entries = table->entries;
+
+        /// Walk down (and create) the sub-tables until the rest of the code fits into one table
+        while (len - consumed > table_bits) {
+            uint64_t prefix = (code >> (len - consumed - table_bits)) & ((1 << table_bits) - 1);
+            DecodeEntry *entry = &entries[reverse_bits(prefix, table_bits)];
+
+            if (!entry->link) {
+                entry->link = 1;
+                entry->len = table_bits;
+                entry->value = table->nof_subtables++;
+            }
+
+            entries = table->entries + DECODE_TABLE_SIZE + entry->value * DECODE_SUBTABLE_SIZE;
+            consumed += table_bits;
+            table_bits = DECODE_SUBTABLE_BITS;
         }
 
-        if (*next == NULL) {
-            *next = huffman_node_new();
-            if (got_error()) return;
+        if (symbol->character == EOF_BYTE) {
+            table->has_eof = true;
         }
 
-        node = *next;
-        index -= 1;
+        uint8_t rest = len - consumed;
+        decode_table_fill(entries, table_bits, code & ((1 << rest) - 1), rest, symbol->character);
+        logfmt("decode table: character %d has code %ld with size %ld", symbol->character, code, len);
+    }
+}
+
+void decode_table_free(DecodeTable *table) {
+    if (table->entries) {
+        free(table->entries);
+        table->entries = NULL;
     }
 
-    node->value = symbol->character;
+    table->nof_subtables = 0;
 }
 
-uint16_t huffman_node_read_next(HuffmanNode *node, BitArray *input) {
-    int depth = 0;
-    while (node->value == HUFFMAN_NULL_VAL) {
-        HuffmanNode **next = NULL;
+void decode_table_fill(DecodeEntry *entries, size_t table_bits, uint64_t code, uint8_t len, uint16_t value) {
+    /// The stream is read LSB first while the codes are written MSB first,
+    /// so every index whose lowest `len` bits are the reversed code belongs to this symbol
+    size_t step = (size_t)1 << len;
+    for (size_t i = reverse_bits(code, len); i < ((size_t)1 << table_bits); i += step) {
+        entries[i].value = value;
+        entries[i].len = len;
+        entries[i].link = 0;
+    }
+}
 
-        if (bit_array_read(input)) {
-            next = &node->left;
-        } else {
-            next = &node->right;
-        }
+uint16_t decode_table_read_next(DecodeTable *table, BitReader *reader) {
+    DecodeEntry entry = table->entries[bit_reader_peek(reader, DECODE_TABLE_BITS)];
 
-        if (*next == NULL) {
-            fprintf(stderr, "ERR huffman_node_read_next: Cannot find the matching prefix\n");
-            set_error(Error_IndexOutOfBound);
-            return 0;
-        }
+    while (entry.link) {
+        bit_reader_consume(reader, entry.len);
+        uint64_t bits = bit_reader_peek(reader, DECODE_SUBTABLE_BITS);
+        entry = table->entries[DECODE_TABLE_SIZE + entry.value * DECODE_SUBTABLE_SIZE + bits];
+    }
 
-        node = *next;
-        depth += 1;
+    if (!entry.len) {
+        fprintf(stderr, "ERR decode_table_read_next: Cannot find the matching prefix\n");
+        set_error(Error_IndexOutOfBound);
+        return 0;
     }
 
-    logfmt("read depth %d with %d", depth, node->value);
+    bit_reader_consume(reader, entry.len);
+
+    if (bit_reader_overrun(reader)) {
+        set_error(Error_IndexOutOfBound);
+        return 0;
+    }
 
-    return node->value;
+    return entry.value;
 }
 
-HuffmanNode *build_huffman_tree(Symbols *symbols) {
-    HuffmanNode *root = huffman_node_new();
-    if (got_error()) return NULL;
+void multi_decode_table_build(MultiDecodeTable multi, DecodeTable *table) {
+    for (size_t index = 0; index < DECODE_TABLE_SIZE; index++) {
+        MultiDecodeEntry *entry = &multi[index];
+        entry->count = 0;
+        entry->len = 0;
 
-    for (size_t i = 0; i < symbols->size; i++) {
-        huffman_node_insert(root, &symbols->data[i]);
+        /// Greedily chain whole codes as long as they are fully determined by the index bits
+        while (entry->count < MULTI_DECODE_MAX_SYMBOLS) {
+            DecodeEntry next = table->entries[(index >> entry->len) & (DECODE_TABLE_SIZE - 1)];
 
-        if (got_error()) {
-            huffman_node_free(root);
-            return NULL;
+            if (next.link || !next.len || next.value == EOF_BYTE || entry->len + next.len > DECODE_TABLE_BITS) {
+                break;
+            }
+
+            entry->symbols[entry->count++] = next.value;
+            entry->len += next.len;
         }
     }
+}
 
-    return root;
+bool multi_decode_is_worth(Symbols *symbols) {
+    /// Sorted by code length, a probe can only yield several symbols if at least two of the shortest codes fit
+    return symbols->size && symbols->data[0].code.len * 2 <= DECODE_TABLE_BITS;
 }
 
-void bit_array_push_code(BitArray *arr, Code code) {
-    /// Pushing using order MSB 
-    int index = code.len - 1;
-    for (int i = 0; i < code.len; i++) {
-        bool bit = (code.code >> index) & 1;
-        bit_array_push(arr, bit);
-        if (got_error()) return;
-        index -= 1;
+uint64_t reverse_bits(uint64_t value, size_t len) {
+    uint64_t result = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        result = (result << 1) | (value & 1);
+        value >>= 1;
     }
+
+    return result;
+}
+
+bool huffman_has_magic(uint8_t *bytes, size_t len) {
+    return len >= 4 && bytes[0] == 0xFF && bytes[1] == 0xFF && bytes[2] == 0xFF;
 }
 
+bool huffman_has_long_runs(uint8_t *bytes, size_t len) {
+    return len >= 4 && bytes[0] == 0xFF && bytes[1] == 0xFF && bytes[2] == 0xFC;
+}
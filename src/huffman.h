@@ -9,6 +9,52 @@
 #define HUFFMAN_H
 
 #include "bit_array.h"
+#include "segments.h"
+#include "histogram.h"
+
+/**
+ * @brief Strategy of the table lookups used while decoding.
+ */
+typedef enum {
+    HuffmanDecodeMode_Auto, /**< Pick based on the code lengths of the stream */
+    HuffmanDecodeMode_Single, /**< One symbol per table lookup */
+    HuffmanDecodeMode_Multi, /**< Several short symbols per table lookup, for low entropy data */
+    HuffmanDecodeMode_Speculative, /**< Single stream split across threads at guessed positions, relying on self-synchronization */
+} HuffmanDecodeMode;
+
+/// Maximum number of interleaved streams
+#define HUFFMAN_MAX_STREAMS 256
+
+/// Largest chunk of the chunked format, its size is stored in 32 bits
+#define HUFFMAN_MAX_CHUNK_SIZE UINT32_MAX
+
+/// Maximum number of tables clustered from the block tables, the index of a table fits into a byte
+#define HUFFMAN_MAX_TABLES 256
+
+/// Maximum number of context tables, one per bit width of the previous byte taken as a signed value
+#define HUFFMAN_MAX_CONTEXTS 8
+
+/// Hard limit of the code length accepted by both the encoder and the decoder
+#define HUFFMAN_MAX_CODE_LEN 32
+/// Code length limit used when none is given, every code is then resolved within two table lookups
+#define HUFFMAN_DEFAULT_CODE_LEN 15
+
+/**
+ * @brief Options of the compressed format.
+ */
+typedef struct {
+    size_t nof_streams; /**< Number of interleaved streams, 1 keeps the single stream format */
+    size_t max_code_len; /**< Maximum length of a code (up to `HUFFMAN_MAX_CODE_LEN`), 0 for the default */
+    size_t chunk_size; /**< Input bytes per independently decodable chunk, 0 keeps a single chunk */
+    size_t nof_threads; /**< Threads of the single stream encoder, 0 to decide based on the input size and CPU count */
+    bool is_legacy_table; /**< Keep the original symbol table even when the compact one is smaller */
+    bool is_eof_symbol; /**< Terminate the data with the EOF symbol as the original format, instead of storing its length */
+    bool has_block_tables; /**< Let each segment of the input carry its own table where it pays off, cannot be combined with streams, chunks or EOF */
+    size_t nof_tables; /**< With block tables, cluster the segments into at most this many shared tables instead (up to `HUFFMAN_MAX_TABLES`), 0 to decide per segment */
+    size_t nof_contexts; /**< Code every byte with one of at most this many tables selected by the previous byte (up to `HUFFMAN_MAX_CONTEXTS`), cannot be combined with streams, chunks, EOF or block tables, 0 for one table */
+    bool has_pairs; /**< Code pairs of bytes as single symbols where it is smaller, also than the block tables or contexts, cannot be combined with streams, chunks or EOF */
+    bool has_long_runs; /**< Mark the data as run-length encoded with runs of any length (`RleFormat_Long`), read back by `huffman_has_long_runs` */
+} HuffmanOptions;
 
 /**
  * @brief Compresses data using Canonical Huffman coding.
@@ -18,6 +64,74 @@
  */
 BitArray huffman_compress(uint8_t *bytes, size_t len);
 
+/**
+ * @brief Compresses data using Canonical Huffman coding with the given format options.
+ *
+ * With more than one stream, symbol `i` is coded into stream `i % nof_streams`. All streams share
+ * the same codebook and their byte sizes are stored in a jump table in the header, so a decoder
+ * can keep several independent bit readers busy at once.
+ *
+ * With a chunk size, the data is cut into chunks coded with the same codebook, each one starts
+ * on a byte boundary. The header records the decoded length and the offset of every chunk,
+ * so the decoder decodes them in parallel directly into the output.
+ *
+ * Unless `is_eof_symbol` is set, the header stores the decoded length and the alphabet has no EOF,
+ * so the decoder allocates the output once and decodes a known number of symbols.
+ *
+ * With block tables, a segment whose statistics differ enough from the rest is coded with its own
+ * table, stored right before its codes, whenever that is smaller than using the shared table.
+ * With a number of tables, the segment histograms are clustered into that many tables at most,
+ * stored once, and every run of segments only refers to one of them by its index.
+ *
+ * With contexts, the previous byte of the input is taken as a signed value and the bit width of its
+ * magnitude selects the table of the next one. The coder does not know what the bytes stand for: after
+ * the model and RLE, the previous byte is a literal residual as often as a flag byte or a run count.
+ * The encoder picks the number of contexts giving the smallest output, or keeps a single table.
+ *
+ * With pairs, the symbols are pairs of bytes from a dictionary of up to 256 of the most frequent ones,
+ * the others are stored raw after an escape symbol. A symbol is no longer limited to one bit per byte,
+ * which pays off for nearly constant data. Single bytes, or the block tables and contexts if requested,
+ * are kept whenever they are smaller.
+ *
+ * @param bytes Pointer to the byte array to be compressed.
+ * @param len Length of the byte array.
+ * @param options Format options.
+ * @return BitArray The compressed data.
+ */
+BitArray huffman_compress_with_options(uint8_t *bytes, size_t len, HuffmanOptions *options);
+
+/**
+ * @brief Compresses a chain of segments as one stream, without joining them first.
+ *
+ * @param input Pointer to the segments of the data to be compressed.
+ * @param options Format options.
+ * @param output Pointer to the list the compressed segments are appended to.
+ * @note On error, the output may contain a part of the compressed data.
+ */
+void huffman_compress_segments(SegmentList *input, HuffmanOptions *options, SegmentList *output);
+
+/**
+ * @brief Builds the code lengths of a table for the given frequencies, as the encoder would.
+ *
+ * @param freq Frequencies of the bytes.
+ * @param lens Code length of every byte, 0 for a byte missing from the table.
+ */
+void huffman_build_code_lens(uint64_t freq[HISTOGRAM_LEN], uint8_t lens[HISTOGRAM_LEN]);
+
+/**
+ * @brief Size of a segment coded with the shared table, without coding it.
+ *
+ * With `has_own_table`, the segment is coded with its own table instead whenever its codes
+ * and the compact table are smaller, as a segment with block tables.
+ *
+ * @param bytes Pointer to the byte array to be measured.
+ * @param len Length of the byte array.
+ * @param lens Code lengths of the shared table from `huffman_build_code_lens`, a missing byte counts as one of the longest codes.
+ * @param has_own_table Whether the segment may carry its own table.
+ * @return Number of bits of the codes and the own table, without the header of the format.
+ */
+size_t huffman_segment_bit_len(uint8_t *bytes, size_t len, uint8_t lens[HISTOGRAM_LEN], bool has_own_table);
+
 /**
  * @brief Decompresses data compressed using Canonical Huffman coding.
  * @param bytes Pointer to the compressed byte array.
@@ -26,4 +140,21 @@ BitArray huffman_compress(uint8_t *bytes, size_t len);
  */
 BitArray huffman_decompress(uint8_t *bytes, size_t len);
 
+/**
+ * @brief Decompresses data compressed using Canonical Huffman coding with the given decoding strategy.
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @param mode Table lookup strategy, the output is the same for every mode.
+ * @return BitArray The decompressed data.
+ */
+BitArray huffman_decompress_with_mode(uint8_t *bytes, size_t len, HuffmanDecodeMode mode);
+
+/**
+ * @brief Checks whether the data was compressed with `has_long_runs`.
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return true if the data is marked as run-length encoded with runs of any length.
+ */
+bool huffman_has_long_runs(uint8_t *bytes, size_t len);
+
 #endif
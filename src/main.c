@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "image.h"
 #include "args.h"
 #include "error.h"
@@ -7,13 +9,14 @@
 
 size_t load_file(const char *filename, uint8_t **output);
 void save_file(const char *filename, uint8_t *bytes, size_t len);
+void save_segments(const char *filename, SegmentList *segments);
 
 int main(int argc, char **argv) {
     Args args = args_parse(argc, argv);
 
     if (got_error()) return got_error();
     if (args.is_help) {
-        printf("Usage: huff_codec -[cdmawibo:h]\n"
+        printf("Usage: huff_codec -[cdmaprxlwibosk:t:h]\n"
                "  -w <width_value>    Specify the width of the image\n"
                "  -i <ifile>          Input file name\n"
                "  -o <ofile>          Output file name\n"
@@ -23,8 +26,25 @@ int main(int argc, char **argv) {
                "                      [Default: false]\n"
                "  -a                  Activate adaptive image scanning mode\n"
                "                      [Default: false]\n"
+               "  -l                  Store RLE runs of any length as a single token,\n"
+               "                      recorded in the compressed data [Default: false]\n"
+               "  -p                  Huffman code pairs of bytes as one symbol where it is\n"
+               "                      smaller\n"
+               "                      [Default: false]\n"
+               "  -r                  Entropy code the data with rANS instead of Huffman\n"
+               "                      coding [Default: false]\n"
+               "  -x                  Entropy code the data with an adaptive range coder,\n"
+               "                      the smallest but slowest [Default: false]\n"
                "  -b <number>         Specify the block size for adaptive image\n"
                "                      [Default: 16]\n"
+               "  -s <number>         Split the Huffman coded data into interleaved streams\n"
+               "                      [Default: 1]\n"
+               "  -k <KiB>            Split the Huffman coded data into independently\n"
+               "                      decodable chunks, decoded in parallel [e.g. 256]\n"
+               "                      [Default: 0, a single chunk]\n"
+               "  -t <number>         Cluster the blocks of the adaptive mode into at most\n"
+               "                      this many shared Huffman tables\n"
+               "                      [Default: 0, a table per block where it pays off]\n"
                "  -h                  Print this help message\n");
 
         return 0;
@@ -39,11 +59,14 @@ int main(int argc, char **argv) {
         case Mode_Compress: {
             uint32_t height = filesize / args.width;
             Image image = image_from_raw(bytes, args.width, height);
-            BitArray result = compressor_image_compress(&image, &args);
-            if (got_error()) break;
+            SegmentList result = segment_list_new();
+            compressor_image_compress_segments(&image, &args, &result);
 
-            save_file(args.output_filename, result.data, bit_array_byte_len(&result));
-            bit_array_free(&result);
+            if (!got_error()) {
+                save_segments(args.output_filename, &result);
+            }
+
+            segment_list_free(&result);
             break;
         }
 
@@ -116,3 +139,20 @@ void save_file(const char *filename, uint8_t *bytes, size_t len) {
         fprintf(stderr, "Error writing to file: %s\n", filename);
     }
 }
+
+void save_segments(const char *filename, SegmentList *segments) {
+    // Written with a single gathering write, the segments are never joined
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        set_error(Error_InternalError);
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return;
+    }
+
+    segment_list_write(segments, fd);
+
+    if (close(fd) != 0 && !got_error()) {
+        set_error(Error_InternalError);
+        fprintf(stderr, "Error writing to file: %s\n", filename);
+    }
+}
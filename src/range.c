@@ -0,0 +1,341 @@
+/**
+ * @file range.c
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Implementation of `range.h`
+ */
+
+#include "range.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// Leading bytes of the range coded format. A legacy Huffman stream never starts with them, that would
+/// describe 256 symbols where the first (shortest) code is 254 bits long.
+#define RANGE_MAGIC 0xFDFFFF
+
+#define RANGE_PROB_ONE (1 << RANGE_PROB_BITS)
+
+/// A probability moves by 1/4 of its distance towards the coded bit at first,
+/// slowing down with every bit it has seen, until it moves by 1/32
+#define RANGE_ADAPT_FIRST 2
+#define RANGE_ADAPT_LAST 5
+
+/// The range is renormalized a byte at a time whenever it drops below this
+#define RANGE_TOP (1u << 24)
+
+/// Number of contexts, the previous byte selects one
+#define RANGE_NOF_CONTEXTS 256
+
+/// A byte costs at least 8 decisions of the most probable bit. Once the adaptation stops at `RANGE_ADAPT_LAST`,
+/// that bit is at most 1 - 31/4096 likely and costs 0.011 bits, so a byte of the stream describes about 91 bytes
+/// at most, this is a loose bound above it.
+#define RANGE_MAX_RATIO 1024
+
+/// Adaptive probability of a single binary decision
+typedef struct {
+    uint16_t prob; ///< Probability of a zero bit, out of `RANGE_PROB_ONE`
+    uint16_t shift; ///< Current adaptation speed
+} RangeBit;
+
+/// Probabilities of the nodes of the bit tree of a byte, in every context
+typedef struct {
+    RangeBit bits[RANGE_NOF_CONTEXTS][256]; ///< Node 1 is the root, node `n` has the children `2n` and `2n + 1`
+} RangeModel;
+
+typedef struct {
+    BitArray *output;
+    uint64_t low; ///< Lower end of the interval, bit 32 is a carry into the bytes already written
+    uint32_t range;
+    uint8_t cache; ///< Last byte that may still receive a carry
+    size_t cache_size; ///< The cached byte and the number of 0xFF bytes after it
+} RangeEncoder;
+
+typedef struct {
+    uint8_t *bytes;
+    size_t nof_bytes;
+    size_t pos;
+    uint32_t code;
+    uint32_t range;
+} RangeDecoder;
+
+RangeModel *range_model_new();
+void range_encoder_shift_low(RangeEncoder *enc);
+void range_bit_update(RangeBit *model, int bit);
+void range_encode_bit(RangeEncoder *enc, RangeBit *model, int bit);
+int range_decode_bit(RangeDecoder *dec, RangeBit *model);
+void range_encode(SegmentList *input, BitArray *output);
+void range_decode(uint8_t *bytes, size_t nof_bytes, uint8_t *output, size_t len);
+
+BitArray range_compress(uint8_t *bytes, size_t len) {
+    SegmentList input = segment_list_new();
+    SegmentList output = segment_list_new();
+    BitArray result = bit_array_new(NULL, 0);
+
+    segment_list_push_bytes(&input, bytes, len);
+    if (!got_error()) {
+        range_compress_segments(&input, 0, &output);
+    }
+
+    if (!got_error()) {
+        result = segment_list_join(&output);
+    }
+
+    segment_list_free(&input);
+    segment_list_free(&output);
+
+    return result;
+}
+
+void range_compress_segments(SegmentList *input, uint8_t flags, SegmentList *output) {
+    BitArray result = bit_array_new(NULL, 0);
+    size_t len = segment_list_byte_len(input);
+
+    bit_array_push_n(&result, RANGE_MAGIC, 24);
+    bit_array_push_n(&result, flags, 8);
+    bit_array_push_n(&result, len, 64);
+
+    if (len && !got_error()) {
+        range_encode(input, &result);
+    }
+
+    if (got_error()) {
+        bit_array_free(&result);
+        return;
+    }
+
+    logfmt("Compressed to %ld bytes", bit_array_byte_len(&result));
+    segment_list_push(output, &result);
+}
+
+BitArray range_decompress(uint8_t *bytes, size_t len) {
+    BitArray input = bit_array_new(bytes, len);
+    BitArray result = bit_array_new(NULL, 0);
+
+    if (!got_error() && !range_has_magic(bytes, len)) {
+        fprintf(stderr, "ERR range_decompress: Data is not range coded\n");
+        set_error(Error_InvalidFormat);
+    }
+
+    input.cursor = 24;
+    uint8_t flags = got_error() ? 0 : bit_array_read_n(&input, 8);
+    size_t decoded_len = got_error() ? 0 : bit_array_read_n(&input, 64);
+    size_t offset = input.cursor / 8;
+
+    if (!got_error() && flags & ~RANGE_FLAG_LONG_RUNS) {
+        fprintf(stderr, "ERR range_decompress: Unknown format flags 0x%02X\n", flags);
+        set_error(Error_InvalidFormat);
+    }
+
+    /// Keeps a broken header from allocating too much
+    if (!got_error() && decoded_len / RANGE_MAX_RATIO > len - offset) {
+        fprintf(stderr, "ERR range_decompress: Length of %ld bytes is out of the data\n", decoded_len);
+        set_error(Error_InvalidFormat);
+    }
+
+    if (!got_error()) {
+        bit_array_reserve(&result, decoded_len);
+    }
+
+    if (!got_error() && decoded_len) {
+        range_decode(bytes + offset, len - offset, result.data, decoded_len);
+    }
+
+    if (!got_error()) {
+        result.len = decoded_len * 8;
+    } else {
+        bit_array_free(&result);
+    }
+
+    bit_array_free(&input);
+    return result;
+}
+
+uint8_t range_flags(uint8_t *bytes, size_t len) {
+    return range_has_magic(bytes, len) ? bytes[3] : 0;
+}
+
+bool range_has_magic(uint8_t *bytes, size_t len) {
+    return len >= 4 && bytes[0] == 0xFF && bytes[1] == 0xFF && bytes[2] == 0xFD;
+}
+
+RangeModel *range_model_new() {
+    RangeModel *model = malloc(sizeof(RangeModel));
+    if (!model) {
+        set_error(Error_OutOfMemory);
+        return NULL;
+    }
+
+    for (size_t c = 0; c < RANGE_NOF_CONTEXTS; c++) {
+        for (size_t n = 0; n < 256; n++) {
+            model->bits[c][n] = (RangeBit){ .prob = RANGE_PROB_ONE / 2, .shift = RANGE_ADAPT_FIRST };
+        }
+    }
+
+    return model;
+}
+
+/// Writes out the top byte of `low`, holding it back while a carry may still change it
+void range_encoder_shift_low(RangeEncoder *enc) {
+    if ((uint32_t)enc->low < 0xFF000000 || (enc->low >> 32)) {
+        uint8_t carry = enc->low >> 32;
+        uint8_t byte = enc->cache;
+
+        /// Grows by doubling, the final size is not known up front
+        size_t byte_len = bit_array_byte_len(enc->output);
+        if (byte_len + enc->cache_size > enc->output->capacity) {
+            bit_array_reserve(enc->output, byte_len > enc->cache_size ? byte_len : enc->cache_size);
+            if (got_error()) return;
+        }
+
+        for (; enc->cache_size; enc->cache_size--) {
+            enc->output->data[bit_array_byte_len(enc->output)] = byte + carry;
+            enc->output->len += 8;
+            byte = 0xFF;
+        }
+
+        enc->cache = (enc->low >> 24) & 0xFF;
+    }
+
+    enc->cache_size += 1;
+    enc->low = (enc->low & 0x00FFFFFF) << 8;
+}
+
+/// Moves the probability towards the coded bit. It never reaches 0 nor `RANGE_PROB_ONE`.
+void range_bit_update(RangeBit *model, int bit) {
+    if (!bit) {
+        model->prob += (RANGE_PROB_ONE - model->prob) >> model->shift;
+    } else {
+        model->prob -= model->prob >> model->shift;
+    }
+
+    if (model->shift < RANGE_ADAPT_LAST) {
+        model->shift += 1;
+    }
+}
+
+void range_encode_bit(RangeEncoder *enc, RangeBit *model, int bit) {
+    uint32_t bound = (enc->range >> RANGE_PROB_BITS) * model->prob;
+
+    if (!bit) {
+        enc->range = bound;
+    } else {
+        enc->low += bound;
+        enc->range -= bound;
+    }
+
+    range_bit_update(model, bit);
+
+    while (enc->range < RANGE_TOP) {
+        enc->range <<= 8;
+        range_encoder_shift_low(enc);
+    }
+}
+
+int range_decode_bit(RangeDecoder *dec, RangeBit *model) {
+    uint32_t bound = (dec->range >> RANGE_PROB_BITS) * model->prob;
+    int bit = dec->code >= bound;
+
+    if (!bit) {
+        dec->range = bound;
+    } else {
+        dec->code -= bound;
+        dec->range -= bound;
+    }
+
+    range_bit_update(model, bit);
+
+    /// Reading past the end shifts in zeros, it is detected once at the end
+    while (dec->range < RANGE_TOP) {
+        dec->range <<= 8;
+        dec->code = (dec->code << 8) | (dec->pos < dec->nof_bytes ? dec->bytes[dec->pos] : 0);
+        dec->pos += 1;
+    }
+
+    return bit;
+}
+
+void range_encode(SegmentList *input, BitArray *output) {
+    RangeModel *model = range_model_new();
+    if (!model) return;
+
+    RangeEncoder enc = {
+        .output = output,
+        .low = 0,
+        .range = 0xFFFFFFFF,
+        .cache = 0,
+        .cache_size = 1,
+    };
+
+    /// Skewed data takes much less than a byte per byte, the output grows as needed
+    bit_array_reserve(output, segment_list_byte_len(input) / 4 + 16);
+
+    uint8_t prev = 0;
+    for (size_t s = 0; s < input->size && !got_error(); s++) {
+        uint8_t *bytes = input->items[s].data;
+
+        for (size_t i = 0; i < input->items[s].len; i++) {
+            RangeBit *bits = model->bits[prev];
+            size_t node = 1;
+
+            /// Most significant bit first, every node of the tree has its own probability
+            for (int b = 7; b >= 0; b--) {
+                int bit = (bytes[i] >> b) & 1;
+                range_encode_bit(&enc, &bits[node], bit);
+                node = (node << 1) | bit;
+            }
+
+            prev = bytes[i];
+        }
+    }
+
+    /// Flushes all 4 bytes of `low` and the cached byte
+    for (size_t k = 0; k < 5 && !got_error(); k++) {
+        range_encoder_shift_low(&enc);
+    }
+
+    free(model);
+}
+
+void range_decode(uint8_t *bytes, size_t nof_bytes, uint8_t *output, size_t len) {
+    /// The first byte of the encoder is always the initial zero cache
+    if (nof_bytes < 5 || bytes[0]) {
+        fprintf(stderr, "ERR range_decompress: Data does not start a range coded stream\n");
+        set_error(Error_InvalidFormat);
+        return;
+    }
+
+    RangeModel *model = range_model_new();
+    if (!model) return;
+
+    RangeDecoder dec = {
+        .bytes = bytes,
+        .nof_bytes = nof_bytes,
+        .pos = 5,
+        .code = (uint32_t)bytes[1] << 24 | bytes[2] << 16 | bytes[3] << 8 | bytes[4],
+        .range = 0xFFFFFFFF,
+    };
+
+    uint8_t prev = 0;
+    for (size_t i = 0; i < len; i++) {
+        RangeBit *bits = model->bits[prev];
+        size_t node = 1;
+
+        while (node < 256) {
+            node = (node << 1) | range_decode_bit(&dec, &bits[node]);
+        }
+
+        output[i] = prev = node & 0xFF;
+    }
+
+    /// The encoder flushes exactly the bytes the decoder reads
+    if (dec.pos > nof_bytes) {
+        fprintf(stderr, "ERR range_decompress: Data ends before its length\n");
+        set_error(Error_IndexOutOfBound);
+    } else if (dec.pos < nof_bytes) {
+        fprintf(stderr, "ERR range_decompress: Data continues past its length\n");
+        set_error(Error_InvalidFormat);
+    }
+
+    free(model);
+}
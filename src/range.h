@@ -0,0 +1,70 @@
+/**
+ * @file range.h
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Adaptive binary range coding, an entropy coder without any stored table
+ */
+
+#ifndef RANGE_H
+#define RANGE_H
+
+#include "bit_array.h"
+#include "segments.h"
+
+/// Precision of the bit probabilities
+#define RANGE_PROB_BITS 12
+
+/// Format flag of the data, it is run-length encoded with runs of any length (`RleFormat_Long`)
+#define RANGE_FLAG_LONG_RUNS 0x01
+
+/**
+ * @brief Compresses data using a range coder driven by adaptive models.
+ *
+ * Every byte is coded as 8 binary decisions down a bit tree, the probabilities are conditioned
+ * on the previous byte and learn as the data goes. Nothing is counted up front and no table is
+ * stored, the decoder learns the very same probabilities. Slower than both Huffman coding and
+ * rANS, meant for data where the size matters the most.
+ *
+ * @param bytes Pointer to the byte array to be compressed.
+ * @param len Length of the byte array.
+ * @return BitArray The compressed data.
+ */
+BitArray range_compress(uint8_t *bytes, size_t len);
+
+/**
+ * @brief Compresses a chain of segments as one stream, without joining them first.
+ *
+ * @param input Pointer to the segments of the data to be compressed.
+ * @param flags Format flags of the data (`RANGE_FLAG_*`), stored for its decoder.
+ * @param output Pointer to the list the compressed data is appended to.
+ */
+void range_compress_segments(SegmentList *input, uint8_t flags, SegmentList *output);
+
+/**
+ * @brief Decompresses data compressed by `range_compress`.
+ *
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return BitArray The decompressed data.
+ */
+BitArray range_decompress(uint8_t *bytes, size_t len);
+
+/**
+ * @brief Checks whether the data starts as a stream of `range_compress`.
+ *
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return true if the data is range coded.
+ */
+bool range_has_magic(uint8_t *bytes, size_t len);
+
+/**
+ * @brief Reads the format flags of the data stored by `range_compress_segments`.
+ *
+ * @param bytes Pointer to the compressed byte array.
+ * @param len Length of the compressed byte array.
+ * @return The `RANGE_FLAG_*` flags, 0 if the data is not range coded.
+ */
+uint8_t range_flags(uint8_t *bytes, size_t len);
+
+#endif
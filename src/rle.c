@@ -9,79 +9,162 @@
 #include "error.h"
 #include <string.h>
 
-BitArray rle_encode(uint8_t *bytes, size_t len) { 
-    BitArray result = bit_array_new(NULL, 0); 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define RLE_X86
+#include <immintrin.h>
+#endif
+
+/// Finds the length of the run starting at the first byte, `len` is at least 1
+typedef size_t (*RleRunFn)(uint8_t *bytes, size_t len);
+
+size_t rle_run_scalar(uint8_t *bytes, size_t len);
+size_t rle_run_sse2(uint8_t *bytes, size_t len);
+size_t rle_run_avx2(uint8_t *bytes, size_t len);
+size_t rle_run_tail(uint8_t *bytes, size_t n, size_t len);
+RleRunFn rle_kernel(RleKernel kernel);
+size_t rle_decode_long(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len);
+
+/// Most bytes a group of 8 tokens decodes to
+#define RLE_MAX_GROUP_OUTPUT (8 * RLE_MAX_RUN)
+
+/// Short runs and literals are stored as a whole vector, which may spill this many bytes past them.
+/// The spill is overwritten by the next token, or is still within the output.
+#define RLE_SLACK 16
+
+/// Number of bytes the 8 tokens after a flag byte take, a byte per literal and two per run
+#define RLE_B2(n) n, n + 1, n + 1, n + 2
+#define RLE_B4(n) RLE_B2(n), RLE_B2(n + 1), RLE_B2(n + 1), RLE_B2(n + 2)
+#define RLE_B6(n) RLE_B4(n), RLE_B4(n + 1), RLE_B4(n + 1), RLE_B4(n + 2)
+static const uint8_t RLE_GROUP_LEN[256] = { RLE_B6(8), RLE_B6(9), RLE_B6(9), RLE_B6(10) };
+
+size_t rle_max_encoded_len(size_t len) {
+    return len + (len + 7) / 8;
+}
+
+BitArray rle_encode(uint8_t *bytes, size_t len) {
+    return rle_encode_with(bytes, len, RleFormat_Short, RleKernel_Auto);
+}
+
+BitArray rle_encode_with(uint8_t *bytes, size_t len, RleFormat format, RleKernel kernel) {
+    BitArray result = bit_array_new(NULL, 0);
     if (!len) return result;
-    bool has_previous = false;
-    uint8_t previous;
-    uint16_t count = 0;
-    size_t index = 0;
-
-    for (size_t i = 0; i < len; i++) {
-        uint8_t byte = bytes[i];
-
-        if (!has_previous) {
-            logfmt("Start new byte %d", byte);
-            previous = byte;
-            has_previous = true;
-            count = 0;
-
-            if (index % 8 == 0) {
-                index = bit_array_bit_len(&result);
-                bit_array_push_n(&result, 0, 8); // For metadata
-            }
+    bit_array_reserve(&result, rle_max_encoded_len(len));
+    if (got_error()) return result;
+
+    result.len = rle_encode_into(bytes, len, result.data, format, kernel) * 8;
 
-            continue;
+    bit_array_shrink_to_fit(&result);
+    return result;
+}
+
+size_t rle_encode_into(uint8_t *bytes, size_t len, uint8_t *output, RleFormat format, RleKernel kernel) {
+    RleRunFn run_len = rle_kernel(kernel);
+    uint8_t *out = output;
+    uint8_t *flags = NULL;
+    size_t nof_tokens = 0;
+
+    for (size_t i = 0; i < len; nof_tokens++) {
+        /// A literal is told by the next byte alone, without calling the kernel
+        size_t max_run = len - i < RLE_MAX_RUN || format == RleFormat_Long ? len - i : RLE_MAX_RUN;
+        size_t run = max_run > 1 && bytes[i + 1] == bytes[i] ? run_len(bytes + i, max_run) : 1;
+
+        /// The flag byte of the next 8 tokens is patched as they are written
+        if (nof_tokens % 8 == 0) {
+            flags = out++;
+            *flags = 0;
         }
 
-        if (byte == previous) {
-            count += 1;
-
-            /// Reach maximum number of count allowed
-            if (count == 0xFF + 1) {
-                logfmt("Insert Index %ld (%ld) byte %d count %d", index, index % 8, byte, count);
-                bit_array_set_one_at(&result, index);
-                bit_array_push_n(&result, count - 1, 8);
-                bit_array_push_n(&result, previous, 8);
-                has_previous = false;
-                index += 1;
-            }
-        } else {
-            logfmt("Insert Index %ld (%ld) byte %d count %d", index, index % 8, byte, count);
-            if (count) {
-                bit_array_set_one_at(&result, index);
-                bit_array_push_n(&result, count - 1, 8);
-            }
+        logfmt("Insert token %ld byte %d run %ld", nof_tokens, bytes[i], run);
+        if (run > 1 && format == RleFormat_Short) {
+            /// The last run stores one repeat more than it has, the decoder stops at the output length
+            bool is_last = i + run == len && run < RLE_MAX_RUN;
+            *flags |= 1 << (nof_tokens % 8);
+            *out++ = is_last ? run - 1 : run - 2;
+        } else if (run > 1) {
+            *flags |= 1 << (nof_tokens % 8);
 
-            bit_array_push_n(&result, previous, 8);
-            has_previous = false;
-            index += 1;
-            i -= 1; // Redo this loop
+            if (run < RLE_MAX_RUN) {
+                *out++ = run - 2;
+            } else {
+                /// 7 bits of the repeats past 257 per byte, the lowest first, the top bit tells that more follow
+                size_t extra = run - RLE_MAX_RUN;
+                *out++ = 0xFF;
+
+                while (extra > 0x7F) {
+                    *out++ = (extra & 0x7F) | 0x80;
+                    extra >>= 7;
+                }
+
+                *out++ = extra;
+            }
         }
+
+        *out++ = bytes[i];
+        i += run;
     }
 
-    /// Push the remaining into the output
-    if (has_previous) {
-        if (count) {
-            bit_array_set_one_at(&result, index);
-            bit_array_push_n(&result, count, 8);
-        }
+    return out - output;
+}
 
-        bit_array_push_n(&result, previous, 8);
+size_t rle_decode_with(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len, RleFormat format) {
+    switch (format) {
+        case RleFormat_Short:
+            break;
+        case RleFormat_Long:
+            return rle_decode_long(bytes, len, output, output_len);
     }
 
-    return result;
+    return rle_decode(bytes, len, output, output_len);
 }
 
 size_t rle_decode(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len) {
     size_t output_index = 0;
     size_t i = 0;
 
+    /// Whole groups are decoded without any bounds check while both their tokens and their
+    /// longest possible output fit, the rest is left to the careful loop below
+    while (i < len && output_len - output_index >= RLE_MAX_GROUP_OUTPUT + RLE_SLACK) {
+        uint8_t metadata = bytes[i];
+        if (i + 1 + RLE_GROUP_LEN[metadata] + RLE_SLACK > len) break;
+
+        uint8_t *input = bytes + i + 1;
+        uint8_t *out = output + output_index;
+        unsigned flags = metadata | 0x100; // Stops the literal stretch after the last token
+
+        for (int j = 0; j < 8;) {
+            if (!((flags >> j) & 1)) {
+                /// Consecutive literals are copied in one go, as a whole word
+                int nof_literals = __builtin_ctz(flags >> j);
+                memcpy(out, input, 8);
+                out += nof_literals;
+                input += nof_literals;
+                j += nof_literals;
+            } else {
+                size_t repeat = input[0] + 2;
+                memset(out, input[1], RLE_SLACK);
+                if (repeat > RLE_SLACK) {
+                    memset(out + RLE_SLACK, input[1], repeat - RLE_SLACK);
+                }
+
+                out += repeat;
+                input += 2;
+                j += 1;
+            }
+        }
+
+        i = input - bytes;
+        output_index = out - output;
+    }
+
+    if (output_index >= output_len && output_len) {
+        return i;
+    }
+
     while (i < len) {
         uint8_t metadata = bytes[i++];
         logfmt("RLE decoding with metadata %d", metadata);
         for (int j = 0; j < 8 && i < len; j++) {
-            uint16_t repeat = 1; // 16bit number because it can be up to 257 times
+            size_t repeat = 1; // Can be up to 257 times
 
             if (metadata & 1) {
                 repeat = bytes[i++] + 2;
@@ -93,12 +176,12 @@ size_t rle_decode(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len
 
             uint8_t byte = bytes[i++];
 
-            logfmt("RLE pushing %d %d times", byte, repeat);
+            logfmt("RLE pushing %d %ld times", byte, repeat);
 
-            // Pushing bytes into the result
-            for (int k = 0; k < repeat && output_index < output_len; k++) {
-                output[output_index++] = byte;
-            }
+            // Pushing bytes into the result, a run past the expected output is cut
+            size_t nof_bytes = repeat < output_len - output_index ? repeat : output_len - output_index;
+            memset(output + output_index, byte, nof_bytes);
+            output_index += nof_bytes;
 
             if (output_index >= output_len) {
                 return i;
@@ -110,3 +193,151 @@ size_t rle_decode(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len
 
     return i;
 }
+
+size_t rle_decode_long(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len) {
+    size_t output_index = 0;
+    size_t i = 0;
+
+    /// A run may be longer than any group, so every token is checked, though still filled in bulk
+    while (i < len && output_index < output_len) {
+        unsigned metadata = bytes[i++] | 0x100;
+
+        for (int j = 0; j < 8 && i < len;) {
+            size_t remaining = output_len - output_index;
+
+            if (!((metadata >> j) & 1)) {
+                /// Consecutive literals are copied in one go
+                size_t nof_literals = __builtin_ctz(metadata >> j);
+                if (nof_literals > len - i) nof_literals = len - i;
+                if (nof_literals > remaining) nof_literals = remaining;
+
+                memcpy(output + output_index, bytes + i, nof_literals);
+                output_index += nof_literals;
+                i += nof_literals;
+                j += nof_literals;
+            } else {
+                uint8_t count = bytes[i++];
+                size_t repeat = count + 2;
+
+                if (count == 0xFF) {
+                    size_t extra = 0;
+                    uint8_t byte = 0x80;
+
+                    for (size_t shift = 0; byte & 0x80; shift += 7) {
+                        if (i == len || shift > 56) {
+                            set_error(i == len ? Error_IndexOutOfBound : Error_InvalidFormat);
+                            return i;
+                        }
+
+                        byte = bytes[i++];
+                        extra |= (size_t)(byte & 0x7F) << shift;
+                    }
+
+                    repeat = RLE_MAX_RUN + extra;
+                }
+
+                if (i == len) {
+                    set_error(Error_IndexOutOfBound);
+                    return i;
+                }
+
+                // Pushing bytes into the result, a run past the expected output is cut
+                size_t nof_bytes = repeat < remaining ? repeat : remaining;
+                memset(output + output_index, bytes[i++], nof_bytes);
+                output_index += nof_bytes;
+                j += 1;
+            }
+
+            if (output_index >= output_len) {
+                return i;
+            }
+        }
+    }
+
+    return i;
+}
+
+RleRunFn rle_kernel(RleKernel kernel) {
+#ifdef RLE_X86
+    __builtin_cpu_init();
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    bool has_sse2 = __builtin_cpu_supports("sse2");
+#else
+    bool has_avx2 = false;
+    bool has_sse2 = false;
+#endif
+
+    switch (kernel) {
+        case RleKernel_Scalar:
+            return rle_run_scalar;
+        case RleKernel_Sse2:
+            return has_sse2 ? rle_run_sse2 : rle_run_scalar;
+        case RleKernel_Auto:
+        case RleKernel_Avx2:
+            break;
+    }
+
+    return has_avx2 ? rle_run_avx2 : has_sse2 ? rle_run_sse2 : rle_run_scalar;
+}
+
+size_t rle_run_tail(uint8_t *bytes, size_t n, size_t len) {
+    while (n < len && bytes[n] == bytes[0]) {
+        n += 1;
+    }
+
+    return n;
+}
+
+size_t rle_run_scalar(uint8_t *bytes, size_t len) {
+    return rle_run_tail(bytes, 1, len);
+}
+
+#ifdef RLE_X86
+
+/// Compares 16 bytes against the first one at a time, the first mismatch ends the run
+__attribute__((target("sse2")))
+size_t rle_run_sse2(uint8_t *bytes, size_t len) {
+    __m128i value = _mm_set1_epi8((char)bytes[0]);
+    size_t n = 0;
+
+    for (; n + 16 <= len; n += 16) {
+        __m128i data = _mm_loadu_si128((const __m128i *)(bytes + n));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, value));
+
+        if (mask != 0xFFFF) {
+            return n + __builtin_ctz(~mask);
+        }
+    }
+
+    return rle_run_tail(bytes, n, len);
+}
+
+/// Same as `rle_run_sse2` with 32 bytes at a time
+__attribute__((target("avx2")))
+size_t rle_run_avx2(uint8_t *bytes, size_t len) {
+    __m256i value = _mm256_set1_epi8((char)bytes[0]);
+    size_t n = 0;
+
+    for (; n + 32 <= len; n += 32) {
+        __m256i data = _mm256_loadu_si256((const __m256i *)(bytes + n));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, value));
+
+        if (mask != 0xFFFFFFFF) {
+            return n + __builtin_ctz(~mask);
+        }
+    }
+
+    return rle_run_tail(bytes, n, len);
+}
+
+#else
+
+size_t rle_run_sse2(uint8_t *bytes, size_t len) {
+    return rle_run_scalar(bytes, len);
+}
+
+size_t rle_run_avx2(uint8_t *bytes, size_t len) {
+    return rle_run_scalar(bytes, len);
+}
+
+#endif
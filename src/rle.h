@@ -10,6 +10,27 @@
 
 #include "bit_array.h"
 
+/// Longest run a single token of `RleFormat_Short` can describe, a count byte holds the repeats past the second byte
+#define RLE_MAX_RUN (0xFF + 2)
+
+/**
+ * @brief Enumeration of the RLE formats, both share the flag bytes and differ in the run counts.
+ */
+typedef enum {
+    RleFormat_Short, /**< Original format, a run takes a count byte and runs longer than 257 are split */
+    RleFormat_Long, /**< Count byte 0xFF is followed by a varint of the repeats past 257, any run is a single token */
+} RleFormat;
+
+/**
+ * @brief Enumeration of the run detection kernels.
+ */
+typedef enum {
+    RleKernel_Auto, /**< Best kernel supported by the running CPU */
+    RleKernel_Scalar, /**< Portable byte by byte kernel */
+    RleKernel_Sse2, /**< SSE2 kernel comparing 16 bytes at a time, falls back to scalar when not supported */
+    RleKernel_Avx2, /**< AVX2 kernel comparing 32 bytes at a time, falls back to SSE2 when not supported */
+} RleKernel;
+
 /**
  * @brief Encodes the input data using Run-Length Encoding (RLE).
  *
@@ -19,6 +40,39 @@
  */
 BitArray rle_encode(uint8_t *bytes, size_t len);
 
+/**
+ * @brief Same as `rle_encode` with an explicit format and run detection kernel.
+ * @param bytes Pointer to the array of bytes representing the input data.
+ * @param len The length of the input data array.
+ * @param format Format of the encoded data.
+ * @param kernel Run detection kernel to be used.
+ * @return BitArray A BitArray object representing the RLE-encoded data.
+ */
+BitArray rle_encode_with(uint8_t *bytes, size_t len, RleFormat format, RleKernel kernel);
+
+/**
+ * @brief Encodes the input data straight into a byte buffer, without any allocation.
+ * @param bytes Pointer to the array of bytes representing the input data.
+ * @param len The length of the input data array.
+ * @param output Output buffer of at least `rle_max_encoded_len(len)` bytes.
+ * @param format Format of the encoded data.
+ * @param kernel Run detection kernel to be used.
+ * @return The length of the encoded data in bytes.
+ */
+size_t rle_encode_into(uint8_t *bytes, size_t len, uint8_t *output, RleFormat format, RleKernel kernel);
+
+/**
+ * @brief Maximum size of the RLE-encoded data, in either format.
+ *
+ * Every token takes at most one byte per input byte (a literal, or a count and a byte for 2+ repeats,
+ * a count extended by a varint covers at least 257 bytes) and every 8 tokens share one flag byte,
+ * so the output never exceeds `len + ceil(len / 8)` bytes.
+ *
+ * @param len The length of the input data array.
+ * @return Upper bound of the encoded length in bytes.
+ */
+size_t rle_max_encoded_len(size_t len);
+
 /**
  * @brief Decodes the input RLE-encoded data back to its original form.
  *
@@ -30,4 +84,16 @@ BitArray rle_encode(uint8_t *bytes, size_t len);
  */
 size_t rle_decode(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len);
 
+/**
+ * @brief Same as `rle_decode` for data of the given format.
+ *
+ * @param bytes Pointer to the array of bytes representing the RLE-encoded data.
+ * @param len The length of the RLE-encoded data array.
+ * @param output Output data, the address should be large enough to store the decoded data.
+ * @param output_len Length of the expected output data.
+ * @param format Format of the encoded data.
+ * @return The length of decoded data
+ */
+size_t rle_decode_with(uint8_t *bytes, size_t len, uint8_t *output, size_t output_len, RleFormat format);
+
 #endif
@@ -0,0 +1,161 @@
+/**
+ * @file segments.c
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Implementation for `segments.h`
+ */
+
+#include "segments.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+/// Smallest number of segments allocated by a growing list
+#define SEGMENT_CHUNK 8
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+void segment_list_add(SegmentList *list, Segment segment);
+
+SegmentList segment_list_new() {
+    SegmentList list = {0};
+    return list;
+}
+
+void segment_list_free(SegmentList *list) {
+    for (size_t i = 0; i < list->size; i++) {
+        if (list->items[i].is_owned) {
+            free(list->items[i].data);
+        }
+    }
+
+    free(list->items);
+    list->items = NULL;
+    list->size = 0;
+    list->capacity = 0;
+}
+
+void segment_list_add(SegmentList *list, Segment segment) {
+    if (!segment.len) {
+        if (segment.is_owned) free(segment.data);
+        return;
+    }
+
+    if (list->size >= list->capacity) {
+        size_t capacity = list->capacity * 2;
+        if (capacity < SEGMENT_CHUNK) capacity = SEGMENT_CHUNK;
+
+        Segment *items = realloc(list->items, capacity * sizeof(Segment));
+
+        if (!items) {
+            fprintf(stderr, "ERR segment list: Cannot allocate memory\n");
+            set_error(Error_OutOfMemory);
+            if (segment.is_owned) free(segment.data);
+            return;
+        }
+
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    list->items[list->size++] = segment;
+}
+
+void segment_list_push(SegmentList *list, BitArray *arr) {
+    Segment segment = {
+        .data = arr->data,
+        .len = bit_array_byte_len(arr),
+        .is_owned = true,
+    };
+
+    /// The list is the owner now
+    arr->data = NULL;
+    bit_array_free(arr);
+
+    segment_list_add(list, segment);
+}
+
+void segment_list_push_bytes(SegmentList *list, uint8_t *bytes, size_t len) {
+    Segment segment = {
+        .data = bytes,
+        .len = len,
+        .is_owned = false,
+    };
+
+    segment_list_add(list, segment);
+}
+
+void segment_list_append(SegmentList *list, SegmentList *other) {
+    for (size_t i = 0; i < other->size; i++) {
+        segment_list_add(list, other->items[i]);
+    }
+
+    free(other->items);
+    other->items = NULL;
+    other->size = 0;
+    other->capacity = 0;
+}
+
+size_t segment_list_byte_len(SegmentList *list) {
+    size_t len = 0;
+
+    for (size_t i = 0; i < list->size; i++) {
+        len += list->items[i].len;
+    }
+
+    return len;
+}
+
+BitArray segment_list_join(SegmentList *list) {
+    BitArray result = bit_array_new(NULL, 0);
+    bit_array_reserve(&result, segment_list_byte_len(list));
+    if (got_error()) return result;
+
+    for (size_t i = 0; i < list->size; i++) {
+        memcpy(result.data + result.len / 8, list->items[i].data, list->items[i].len);
+        result.len += list->items[i].len * 8;
+    }
+
+    return result;
+}
+
+void segment_list_write(SegmentList *list, int fd) {
+    struct iovec iov[IOV_MAX];
+    size_t index = 0;
+    size_t offset = 0; ///< Bytes of `items[index]` that are already written
+
+    while (index < list->size) {
+        int count = 0;
+
+        for (size_t i = index; i < list->size && count < IOV_MAX; i++) {
+            size_t skip = i == index ? offset : 0;
+            iov[count].iov_base = list->items[i].data + skip;
+            iov[count].iov_len = list->items[i].len - skip;
+            count += 1;
+        }
+
+        ssize_t written = writev(fd, iov, count);
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "ERR segment list: Cannot write the data\n");
+            set_error(Error_InternalError);
+            return;
+        }
+
+        /// Skip over everything that has been written, writes may be partial
+        size_t remaining = written;
+        while (index < list->size && remaining >= list->items[index].len - offset) {
+            remaining -= list->items[index].len - offset;
+            offset = 0;
+            index += 1;
+        }
+
+        offset += remaining;
+    }
+}
@@ -0,0 +1,98 @@
+/**
+ * @file segments.h
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Scatter-gather list of byte buffers
+ */
+
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "bit_array.h"
+
+/**
+ * @brief Structure representing one contiguous part of a stream.
+ */
+typedef struct {
+    uint8_t *data; /**< Pointer to the bytes of the segment */
+    size_t len; /**< Length of the segment in bytes */
+    bool is_owned; /**< Whether the bytes are freed together with the list */
+} Segment;
+
+/**
+ * @brief Structure representing a stream made of a chain of segments, in the spirit of `struct iovec`.
+ */
+typedef struct {
+    Segment *items; /**< Pointer to the segments */
+    size_t size; /**< Number of segments */
+    size_t capacity; /**< Capacity in segments */
+} SegmentList;
+
+/**
+ * @brief Creates a new empty segment list.
+ *
+ * @return SegmentList structure without any segment.
+ */
+SegmentList segment_list_new();
+
+/**
+ * @brief Frees the list together with all the owned segments.
+ *
+ * @param list Pointer to the SegmentList structure to be freed.
+ */
+void segment_list_free(SegmentList *list);
+
+/**
+ * @brief Appends the data of a bit array as a new segment without copying it.
+ *
+ * @param list Pointer to the SegmentList structure.
+ * @param arr Pointer to the BitArray structure, its data is taken over and it is left empty.
+ * @note The last partial byte of the bit array is kept with its zero padding.
+ */
+void segment_list_push(SegmentList *list, BitArray *arr);
+
+/**
+ * @brief Appends borrowed bytes as a new segment.
+ *
+ * @param list Pointer to the SegmentList structure.
+ * @param bytes Pointer to the bytes, they must outlive the list.
+ * @param len Length of the bytes.
+ */
+void segment_list_push_bytes(SegmentList *list, uint8_t *bytes, size_t len);
+
+/**
+ * @brief Moves all the segments of another list to the end of the list.
+ *
+ * @param list Pointer to the SegmentList structure.
+ * @param other Pointer to the SegmentList structure to be moved, it is left empty.
+ */
+void segment_list_append(SegmentList *list, SegmentList *other);
+
+/**
+ * @brief Returns the total number of bytes in all segments.
+ *
+ * @param list Pointer to the SegmentList structure.
+ * @return Total number of bytes.
+ */
+size_t segment_list_byte_len(SegmentList *list);
+
+/**
+ * @brief Copies all segments into a single bit array.
+ *
+ * @param list Pointer to the SegmentList structure.
+ * @return BitArray containing the bytes of every segment in order.
+ */
+BitArray segment_list_join(SegmentList *list);
+
+/**
+ * @brief Writes all segments to a file descriptor with `writev`.
+ *
+ * @param list Pointer to the SegmentList structure.
+ * @param fd File descriptor opened for writing.
+ */
+void segment_list_write(SegmentList *list, int fd);
+
+#endif
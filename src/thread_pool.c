@@ -0,0 +1,91 @@
+/**
+ * @file thread_pool.c
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Implementation for `thread_pool.h`
+ */
+
+#include "thread_pool.h"
+#include "error.h"
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct {
+    ThreadPoolJob job;
+    void *context;
+    size_t nof_jobs;
+    atomic_size_t next; ///< Index of the next job to be taken
+    atomic_int error; ///< First error of a job, errors are per thread
+} ThreadPool;
+
+void *thread_pool_worker(void *arg);
+
+void thread_pool_run(ThreadPoolJob job, void *context, size_t nof_jobs, size_t nof_threads) {
+    if (!nof_threads) nof_threads = thread_pool_nof_cpus();
+    if (nof_threads > nof_jobs) nof_threads = nof_jobs;
+    if (nof_threads > THREAD_POOL_MAX_THREADS) nof_threads = THREAD_POOL_MAX_THREADS;
+
+    ThreadPool pool = {
+        .job = job,
+        .context = context,
+        .nof_jobs = nof_jobs,
+    };
+
+    atomic_init(&pool.next, 0);
+    atomic_init(&pool.error, Error_None);
+
+    pthread_t threads[THREAD_POOL_MAX_THREADS];
+    size_t nof_spawned = 0;
+
+    /// Not being able to spawn a thread only costs time, the rest takes over its jobs
+    for (size_t i = 1; i < nof_threads; i++) {
+        if (pthread_create(&threads[nof_spawned], NULL, thread_pool_worker, &pool) == 0) {
+            nof_spawned += 1;
+        }
+    }
+
+    thread_pool_worker(&pool);
+
+    for (size_t i = 0; i < nof_spawned; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    Error error = atomic_load(&pool.error);
+    if (error) {
+        set_error(error);
+    }
+}
+
+size_t thread_pool_nof_cpus() {
+    long nof_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return nof_cpus < 1 ? 1 : nof_cpus;
+}
+
+void *thread_pool_worker(void *arg) {
+    ThreadPool *pool = arg;
+
+    /// The calling thread may come with an error of its own
+    Error prev = got_error();
+    clear_error();
+
+    while (atomic_load(&pool->error) == Error_None) {
+        size_t index = atomic_fetch_add(&pool->next, 1);
+        if (index >= pool->nof_jobs) break;
+
+        pool->job(pool->context, index);
+
+        if (got_error()) {
+            int expected = Error_None;
+            atomic_compare_exchange_strong(&pool->error, &expected, got_error());
+            clear_error();
+        }
+    }
+
+    if (prev) {
+        set_error(prev);
+    }
+
+    return NULL;
+}
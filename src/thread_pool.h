@@ -0,0 +1,44 @@
+/**
+ * @file thread_pool.h
+ * @author Le Duy Nguyen (xnguye27)
+ * @date 16/10/2026
+ * @brief Running independent jobs on worker threads
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+/// Most worker threads spawned for a single run
+#define THREAD_POOL_MAX_THREADS 64
+
+/**
+ * @brief Function executing a single job.
+ *
+ * @param context Pointer shared by all jobs of the run.
+ * @param index Index of the job.
+ */
+typedef void (*ThreadPoolJob)(void *context, size_t index);
+
+/**
+ * @brief Runs jobs `0..nof_jobs` on worker threads and waits for all of them.
+ *
+ * Jobs are taken in order by whichever thread is free, the calling thread works as well.
+ * The error of a failed job is set in the calling thread and no more jobs are started.
+ *
+ * @param job Function executing a single job.
+ * @param context Pointer passed to every job.
+ * @param nof_jobs Number of jobs.
+ * @param nof_threads Number of threads, 0 for one per CPU.
+ */
+void thread_pool_run(ThreadPoolJob job, void *context, size_t nof_jobs, size_t nof_threads);
+
+/**
+ * @brief Returns the number of CPUs available to the process.
+ *
+ * @return Number of CPUs, at least 1.
+ */
+size_t thread_pool_nof_cpus();
+
+#endif
@@ -0,0 +1,152 @@
+#include "greatest.h"
+#include "../src/error.h"
+#include "../src/ans.h"
+#include "../src/huffman.h"
+
+SUITE(ans);
+
+#define ANS_DATA_SIZE (1024 * 1024)
+uint8_t *ANS_DATA;
+
+static void ans_setup(void *arg) {
+    clear_error();
+    ANS_DATA = malloc(ANS_DATA_SIZE);
+    fill_random(ANS_DATA, ANS_DATA_SIZE);
+    (void)arg;
+}
+
+static void ans_teardown(void *arg) {
+    clear_error();
+    free(ANS_DATA);
+    (void)arg;
+}
+
+TEST ans_correctness() {
+    /// Short lengths end in the middle of a round of the interleaved states
+    size_t lens[] = {0, 1, 2, 3, ANS_NOF_STATES, ANS_NOF_STATES + 1, 1000, ANS_DATA_SIZE};
+
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        BitArray compressed = ans_compress(ANS_DATA, lens[l]);
+        ASSERT_FALSE(got_error());
+        ASSERT(ans_has_magic(compressed.data, bit_array_byte_len(&compressed)));
+
+        BitArray decompressed = ans_decompress(compressed.data, bit_array_byte_len(&compressed));
+        ASSERT_FALSE(got_error());
+        ASSERT_EQ(lens[l], bit_array_byte_len(&decompressed));
+        ASSERT_MEM_EQ(ANS_DATA, decompressed.data, lens[l]);
+
+        bit_array_free(&compressed);
+        bit_array_free(&decompressed);
+    }
+
+    PASS();
+}
+
+TEST ans_skewed() {
+    /// Far below one bit per byte, where Huffman codes cannot follow
+    for (size_t i = 0; i < ANS_DATA_SIZE; i++) {
+        ANS_DATA[i] = ANS_DATA[i] < 250 ? 0 : ANS_DATA[i] % 3 + 1;
+    }
+
+    BitArray huffman = huffman_compress(ANS_DATA, ANS_DATA_SIZE);
+    BitArray compressed = ans_compress(ANS_DATA, ANS_DATA_SIZE);
+    ASSERT_FALSE(got_error());
+    ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&huffman) / 2);
+
+    BitArray decompressed = ans_decompress(compressed.data, bit_array_byte_len(&compressed));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(ANS_DATA_SIZE, bit_array_byte_len(&decompressed));
+    ASSERT_MEM_EQ(ANS_DATA, decompressed.data, ANS_DATA_SIZE);
+
+    /// A single symbol takes no bits at all
+    memset(ANS_DATA, 7, ANS_DATA_SIZE);
+    BitArray single = ans_compress(ANS_DATA, ANS_DATA_SIZE);
+    ASSERT_FALSE(got_error());
+    ASSERT(bit_array_byte_len(&single) < 64);
+
+    BitArray single_decompressed = ans_decompress(single.data, bit_array_byte_len(&single));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(ANS_DATA_SIZE, bit_array_byte_len(&single_decompressed));
+    ASSERT_MEM_EQ(ANS_DATA, single_decompressed.data, ANS_DATA_SIZE);
+
+    bit_array_free(&huffman);
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+    bit_array_free(&single);
+    bit_array_free(&single_decompressed);
+
+    PASS();
+}
+
+TEST ans_format_flags() {
+    SegmentList input = segment_list_new();
+    SegmentList output = segment_list_new();
+    segment_list_push_bytes(&input, ANS_DATA, 10000);
+
+    ans_compress_segments(&input, ANS_FLAG_LONG_RUNS, &output);
+    BitArray compressed = segment_list_join(&output);
+    ASSERT_FALSE(got_error());
+    size_t len = bit_array_byte_len(&compressed);
+    ASSERT_EQ(ANS_FLAG_LONG_RUNS, ans_flags(compressed.data, len));
+
+    /// The flags are kept for the caller, the data decodes the same
+    BitArray decompressed = ans_decompress(compressed.data, len);
+    ASSERT_FALSE(got_error());
+    ASSERT_MEM_EQ(ANS_DATA, decompressed.data, 10000);
+
+    /// Unknown flags are rejected
+    compressed.data[3] |= 0x80;
+    BitArray unknown = ans_decompress(compressed.data, len);
+    ASSERT(got_error());
+    clear_error();
+
+    segment_list_free(&input);
+    segment_list_free(&output);
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+    bit_array_free(&unknown);
+
+    PASS();
+}
+
+TEST ans_invalid() {
+    BitArray compressed = ans_compress(ANS_DATA, 10000);
+    ASSERT_FALSE(got_error());
+    size_t len = bit_array_byte_len(&compressed);
+
+    /// Truncated data runs out before its length
+    BitArray truncated = ans_decompress(compressed.data, len - 100);
+    ASSERT(got_error());
+    clear_error();
+
+    /// Corrupted codes do not end in the initial states
+    compressed.data[len / 2] ^= 0x5A;
+    BitArray corrupted = ans_decompress(compressed.data, len);
+    ASSERT(got_error());
+    clear_error();
+
+    /// A Huffman stream is not taken for rANS
+    BitArray huffman = huffman_compress(ANS_DATA, 10000);
+    ASSERT_FALSE(ans_has_magic(huffman.data, bit_array_byte_len(&huffman)));
+    BitArray wrong = ans_decompress(huffman.data, bit_array_byte_len(&huffman));
+    ASSERT(got_error());
+    clear_error();
+
+    bit_array_free(&compressed);
+    bit_array_free(&truncated);
+    bit_array_free(&corrupted);
+    bit_array_free(&huffman);
+    bit_array_free(&wrong);
+
+    PASS();
+}
+
+GREATEST_SUITE(ans) {
+    GREATEST_SET_SETUP_CB(ans_setup, NULL);
+    GREATEST_SET_TEARDOWN_CB(ans_teardown, NULL);
+
+    RUN_TEST(ans_correctness);
+    RUN_TEST(ans_skewed);
+    RUN_TEST(ans_format_flags);
+    RUN_TEST(ans_invalid);
+}
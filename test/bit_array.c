@@ -195,6 +195,35 @@ TEST _bit_array_concat() {
     PASS();
 }
 
+TEST _bit_array_concat_unaligned() {
+    BitArray expected = bit_array_new(NULL, 0);
+
+    for (size_t shift = 0; shift < 8; shift++) {
+        BitArray rhs = bit_array_new(NULL, 0);
+        for (uint64_t i = 0; i < 37 + shift; i++) {
+            bit_array_push_n(&rhs, (i * 0x2545F4914F6CDD1D) >> 40, 19);
+        }
+
+        bit_array_push_n(&BIT_ARRAY, 0x55, shift + 1);
+        bit_array_push_n(&expected, 0x55, shift + 1);
+
+        bit_array_concat(&BIT_ARRAY, &rhs);
+        for (uint64_t i = 0; i < 37 + shift; i++) {
+            bit_array_push_n(&expected, (i * 0x2545F4914F6CDD1D) >> 40, 19);
+        }
+
+        bit_array_free(&rhs);
+    }
+
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(bit_array_bit_len(&expected), bit_array_bit_len(&BIT_ARRAY));
+    ASSERT_MEM_EQ(expected.data, BIT_ARRAY.data, bit_array_byte_len(&expected));
+
+    bit_array_free(&expected);
+
+    PASS();
+}
+
 TEST _bit_array_multi_bytes() {
     uint32_t data = 0xFAAF8679;
 
@@ -240,6 +269,99 @@ TEST _bit_array_set_one_at() {
     PASS();
 }
 
+TEST _bit_array_reserve() {
+    bit_array_push_n(&BIT_ARRAY, 0x1F, 5);
+    bit_array_reserve(&BIT_ARRAY, 100);
+    ASSERT_EQ(BIT_ARRAY.capacity, 101);
+
+    uint8_t *data = BIT_ARRAY.data;
+    for (int i = 0; i < 100; i++) {
+        bit_array_push_n(&BIT_ARRAY, 0xA5, 8);
+    }
+    ASSERT_EQ(data, BIT_ARRAY.data);
+
+    /// Geometric growth past the reserved room
+    bit_array_push_n(&BIT_ARRAY, 0xA5, 8);
+    ASSERT(BIT_ARRAY.capacity >= 202);
+
+    bit_array_shrink_to_fit(&BIT_ARRAY);
+    ASSERT_EQ(BIT_ARRAY.capacity, 102);
+    ASSERT_EQ(bit_array_read_n(&BIT_ARRAY, 5), 0x1F);
+    for (int i = 0; i < 101; i++) {
+        ASSERT_EQ(bit_array_read_n(&BIT_ARRAY, 8), 0xA5);
+    }
+
+    ASSERT_FALSE(got_error());
+    PASS();
+}
+
+TEST _bit_reader() {
+    for (uint64_t i = 0; i < 200; i++) {
+        bit_array_push_n(&BIT_ARRAY, i & 0x7F, i % 7 + 1);
+    }
+    bit_array_push_n(&BIT_ARRAY, 0xFEDCBA9876543210, 64);
+
+    BitReader reader = bit_reader_new(&BIT_ARRAY);
+    ASSERT_FALSE(got_error());
+
+    for (uint64_t i = 0; i < 200; i++) {
+        size_t n = i % 7 + 1;
+        uint64_t expected = i & 0x7F & ((1 << n) - 1);
+
+        ASSERT_EQ(bit_reader_peek(&reader, n), expected);
+        bit_reader_consume(&reader, n);
+    }
+
+    ASSERT_EQ(bit_reader_read(&reader, 64), 0xFEDCBA9876543210);
+    ASSERT_FALSE(bit_reader_overrun(&reader));
+    ASSERT_FALSE(got_error());
+
+    /// Past the end reads zeros and raises an error
+    ASSERT_EQ(bit_reader_read(&reader, 1), 0);
+    ASSERT(bit_reader_overrun(&reader));
+    ASSERT(got_error());
+
+    PASS();
+}
+
+TEST _bit_writer() {
+    BitArray expected = bit_array_new(NULL, 0);
+
+    /// Start from an unaligned position
+    bit_array_push_n(&BIT_ARRAY, 5, 3);
+    bit_array_push_n(&expected, 5, 3);
+
+    size_t nof_bits = 0;
+    for (uint64_t i = 0; i < 1000; i++) {
+        nof_bits += i % 32 + 1;
+    }
+
+    BitWriter writer = bit_writer_new(&BIT_ARRAY, nof_bits);
+    for (uint64_t i = 0; i < 1000; i++) {
+        size_t n = i % 32 + 1;
+        uint64_t data = (i * 0x9E3779B97F4A7C15) & ((1ULL << n) - 1);
+        bit_writer_push(&writer, data, n);
+        bit_array_push_n(&expected, data, n);
+    }
+    bit_writer_finish(&writer);
+
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(bit_array_bit_len(&expected), bit_array_bit_len(&BIT_ARRAY));
+    ASSERT_MEM_EQ(expected.data, BIT_ARRAY.data, bit_array_byte_len(&expected));
+
+    /// Nothing more was reserved
+    bit_writer_push(&writer, 0xFFFFFFFF, 32);
+    bit_writer_push(&writer, 0xFFFFFFFF, 32);
+    bit_writer_push(&writer, 0xFFFFFFFF, 32);
+    bit_writer_push(&writer, 0xFFFFFFFF, 32);
+    bit_writer_finish(&writer);
+    ASSERT(got_error());
+
+    bit_array_free(&expected);
+
+    PASS();
+}
+
 GREATEST_SUITE(bit_array) {
     GREATEST_SET_SETUP_CB(bit_array_setup, NULL);
     GREATEST_SET_TEARDOWN_CB(bit_array_tear_down, NULL);
@@ -249,8 +371,12 @@ GREATEST_SUITE(bit_array) {
     RUN_TEST(_bit_array_byte_len);
     RUN_TEST(_bit_array_pad_to_byte);
     RUN_TEST(_bit_array_concat);
+    RUN_TEST(_bit_array_concat_unaligned);
     RUN_TEST(_bit_array_read_write);
     RUN_TEST(_bit_array_read_write_n);
     RUN_TEST(_bit_array_multi_bytes);
     RUN_TEST(_bit_array_set_one_at);
+    RUN_TEST(_bit_array_reserve);
+    RUN_TEST(_bit_reader);
+    RUN_TEST(_bit_writer);
 }
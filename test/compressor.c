@@ -3,6 +3,8 @@
 #include "../src/args.h"
 #include "../src/image.h"
 #include "../src/compressor.h"
+#include "../src/ans.h"
+#include "../src/range.h"
 
 Image _IMAGE;
 Args ARGS;
@@ -17,6 +19,13 @@ static void compressor_setup(void *arg) {
     ARGS.image_adaptive = false;
     ARGS.transformace_data = false;
     ARGS.block_size = 128;
+    ARGS.nof_streams = 1;
+    ARGS.chunk_size = 0;
+    ARGS.nof_tables = 0;
+    ARGS.has_pairs = false;
+    ARGS.is_ans = false;
+    ARGS.is_range = false;
+    ARGS.has_long_runs = false;
 
     fill_random(_IMAGE.data, image_size(&_IMAGE));
     clear_error();
@@ -81,6 +90,85 @@ TEST compressor_serialization_transform() {
     PASS();
 }
 
+TEST compressor_ans() {
+    ARGS.is_ans = true;
+    ARGS.transformace_data = true;
+    Image tmp_img = image_new(_IMAGE.width, _IMAGE.height);
+    memcpy(tmp_img.data, _IMAGE.data, image_size(&_IMAGE));
+
+    BitArray compressed = compressor_image_compress(&tmp_img, &ARGS);
+    ASSERT(ans_has_magic(compressed.data, bit_array_byte_len(&compressed)));
+
+    /// The coder is told by the data itself
+    ARGS.is_ans = false;
+    Image decompressed = compressor_image_decompress(compressed.data, bit_array_byte_len(&compressed), &ARGS);
+
+    ASSERT_EQ(_IMAGE.width, decompressed.width);
+    ASSERT_EQ(_IMAGE.height, decompressed.height);
+    ASSERT_MEM_EQ(_IMAGE.data, decompressed.data, image_size(&_IMAGE));
+    PASS();
+}
+
+TEST compressor_range() {
+    ARGS.is_range = true;
+    ARGS.transformace_data = true;
+    ARGS.image_adaptive = true;
+    Image tmp_img = image_new(_IMAGE.width, _IMAGE.height);
+    memcpy(tmp_img.data, _IMAGE.data, image_size(&_IMAGE));
+
+    BitArray compressed = compressor_image_compress(&tmp_img, &ARGS);
+    ASSERT(range_has_magic(compressed.data, bit_array_byte_len(&compressed)));
+
+    ARGS.is_range = false;
+    Image decompressed = compressor_image_decompress(compressed.data, bit_array_byte_len(&compressed), &ARGS);
+
+    ASSERT_EQ(_IMAGE.width, decompressed.width);
+    ASSERT_EQ(_IMAGE.height, decompressed.height);
+    ASSERT_MEM_EQ(_IMAGE.data, decompressed.data, image_size(&_IMAGE));
+    PASS();
+}
+
+TEST compressor_long_runs() {
+    /// A flat background below the noise
+    memset(_IMAGE.data + image_size(&_IMAGE) / 2, 0, image_size(&_IMAGE) / 2);
+
+    /// Huffman coding, rANS and range coding, each records the format for the decoder
+    for (int coder = 0; coder < 3 * 2; coder++) {
+        ARGS.image_adaptive = coder % 2;
+        ARGS.is_ans = coder / 2 == 1;
+        ARGS.is_range = coder / 2 == 2;
+        Image tmp_img = image_new(_IMAGE.width, _IMAGE.height);
+        memcpy(tmp_img.data, _IMAGE.data, image_size(&_IMAGE));
+
+        ARGS.has_long_runs = false;
+        BitArray short_compressed = compressor_image_compress(&tmp_img, &ARGS);
+
+        ARGS.has_long_runs = true;
+        BitArray compressed = compressor_image_compress(&tmp_img, &ARGS);
+        ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&short_compressed));
+
+        /// Neither stream depends on the option when it is decompressed
+        Image short_decompressed = compressor_image_decompress(short_compressed.data, bit_array_byte_len(&short_compressed), &ARGS);
+        ASSERT_FALSE(got_error());
+        ASSERT_MEM_EQ(_IMAGE.data, short_decompressed.data, image_size(&_IMAGE));
+
+        ARGS.has_long_runs = false;
+        Image decompressed = compressor_image_decompress(compressed.data, bit_array_byte_len(&compressed), &ARGS);
+        ASSERT_FALSE(got_error());
+        ASSERT_EQ(_IMAGE.width, decompressed.width);
+        ASSERT_EQ(_IMAGE.height, decompressed.height);
+        ASSERT_MEM_EQ(_IMAGE.data, decompressed.data, image_size(&_IMAGE));
+
+        image_free(&tmp_img);
+        image_free(&short_decompressed);
+        image_free(&decompressed);
+        bit_array_free(&short_compressed);
+        bit_array_free(&compressed);
+    }
+
+    PASS();
+}
+
 GREATEST_SUITE(compressor) {
     GREATEST_SET_SETUP_CB(compressor_setup, NULL);
     GREATEST_SET_TEARDOWN_CB(compressor_tear_down, NULL);
@@ -89,5 +177,8 @@ GREATEST_SUITE(compressor) {
     RUN_TEST(compressor_transform);
     RUN_TEST(compressor_serialization);
     RUN_TEST(compressor_serialization_transform);
+    RUN_TEST(compressor_ans);
+    RUN_TEST(compressor_range);
+    RUN_TEST(compressor_long_runs);
 }
 
@@ -0,0 +1,102 @@
+#include "greatest.h"
+#include "../src/histogram.h"
+
+SUITE(histogram);
+
+#define HISTOGRAM_DATA_SIZE (3 * 1024 * 1024 + 7)
+uint8_t *HISTOGRAM_DATA;
+
+static void histogram_setup(void *arg) {
+    HISTOGRAM_DATA = malloc(HISTOGRAM_DATA_SIZE);
+    fill_random(HISTOGRAM_DATA, HISTOGRAM_DATA_SIZE);
+
+    /// Long runs, as produced by smooth images
+    memset(HISTOGRAM_DATA + 1000, 42, 100000);
+    memset(HISTOGRAM_DATA + 200003, 0, 65);
+    (void)arg;
+}
+
+static void histogram_teardown(void *arg) {
+    free(HISTOGRAM_DATA);
+    (void)arg;
+}
+
+static void histogram_naive(uint64_t *freq, uint8_t *bytes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        freq[bytes[i]] += 1;
+    }
+}
+
+TEST histogram_kernels() {
+    HistogramKernel kernels[] = {HistogramKernel_Auto, HistogramKernel_Scalar, HistogramKernel_Avx2};
+    size_t lengths[] = {0, 1, 31, 32, 33, 100007, HISTOGRAM_DATA_SIZE};
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        uint64_t expected[HISTOGRAM_LEN] = {0};
+        histogram_naive(expected, HISTOGRAM_DATA, lengths[l]);
+
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            uint64_t freq[HISTOGRAM_LEN] = {0};
+            histogram_count_with(freq, HISTOGRAM_DATA, lengths[l], kernels[k], 1);
+            ASSERT_MEM_EQ(expected, freq, sizeof(freq));
+        }
+    }
+
+    PASS();
+}
+
+TEST histogram_threads() {
+    uint64_t expected[HISTOGRAM_LEN] = {0};
+    histogram_naive(expected, HISTOGRAM_DATA, HISTOGRAM_DATA_SIZE);
+
+    for (size_t nof_threads = 0; nof_threads <= 5; nof_threads++) {
+        uint64_t freq[HISTOGRAM_LEN] = {0};
+        histogram_count_with(freq, HISTOGRAM_DATA, HISTOGRAM_DATA_SIZE, HistogramKernel_Auto, nof_threads);
+        ASSERT_MEM_EQ(expected, freq, sizeof(freq));
+    }
+
+    /// Counts are added to the existing ones
+    uint64_t freq[HISTOGRAM_LEN] = {0};
+    histogram_count(freq, HISTOGRAM_DATA, HISTOGRAM_DATA_SIZE);
+    histogram_count(freq, HISTOGRAM_DATA, HISTOGRAM_DATA_SIZE);
+
+    for (size_t i = 0; i < HISTOGRAM_LEN; i++) {
+        ASSERT_EQ(expected[i] * 2, freq[i]);
+    }
+
+    PASS();
+}
+
+TEST histogram_segments() {
+    uint64_t expected[HISTOGRAM_LEN] = {0};
+    histogram_naive(expected, HISTOGRAM_DATA, HISTOGRAM_DATA_SIZE);
+
+    /// Small blocks like the adaptive mode produces, with empty ones in between
+    SegmentList input = segment_list_new();
+    for (size_t i = 0, k = 0; i < HISTOGRAM_DATA_SIZE; k++) {
+        size_t len = k % 5 == 3 ? 0 : 1 + (k * 7919) % 4096;
+        if (len > HISTOGRAM_DATA_SIZE - i) len = HISTOGRAM_DATA_SIZE - i;
+
+        segment_list_push_bytes(&input, HISTOGRAM_DATA + i, len);
+        i += len;
+    }
+
+    for (size_t nof_threads = 0; nof_threads <= 5; nof_threads++) {
+        uint64_t freq[HISTOGRAM_LEN] = {0};
+        histogram_count_segments_with(freq, &input, HistogramKernel_Auto, nof_threads);
+        ASSERT_MEM_EQ(expected, freq, sizeof(freq));
+    }
+
+    segment_list_free(&input);
+
+    PASS();
+}
+
+GREATEST_SUITE(histogram) {
+    GREATEST_SET_SETUP_CB(histogram_setup, NULL);
+    GREATEST_SET_TEARDOWN_CB(histogram_teardown, NULL);
+
+    RUN_TEST(histogram_kernels);
+    RUN_TEST(histogram_threads);
+    RUN_TEST(histogram_segments);
+}
@@ -36,9 +36,553 @@ TEST huffman_correctness() {
     PASS();
 }
 
+TEST huffman_decode_modes() {
+    /// Skewed distribution so that most of the codes are only a few bits long
+    for (size_t i = 0; i < DATA_SIZE; i++) {
+        DATA[i] = DATA[i] < 192 ? DATA[i] % 3 : DATA[i];
+    }
+
+    BitArray compressed = huffman_compress(DATA, DATA_SIZE);
+    BitArray single = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), HuffmanDecodeMode_Single);
+    ASSERT_FALSE(got_error());
+    BitArray multi = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), HuffmanDecodeMode_Multi);
+    ASSERT_FALSE(got_error());
+
+    ASSERT_EQ(DATA_SIZE, bit_array_byte_len(&single));
+    ASSERT_EQ(DATA_SIZE, bit_array_byte_len(&multi));
+    ASSERT_MEM_EQ(DATA, single.data, DATA_SIZE);
+    ASSERT_MEM_EQ(DATA, multi.data, DATA_SIZE);
+
+    bit_array_free(&compressed);
+    bit_array_free(&single);
+    bit_array_free(&multi);
+
+    PASS();
+}
+
+TEST huffman_streams() {
+    HuffmanOptions options = { .nof_streams = 4 };
+
+    /// Length not divisible by the number of streams
+    BitArray compressed = huffman_compress_with_options(DATA, DATA_SIZE - 3, &options);
+    ASSERT_FALSE(got_error());
+    BitArray decompressed = huffman_decompress(compressed.data, bit_array_byte_len(&compressed));
+    ASSERT_FALSE(got_error());
+
+    ASSERT_EQ(DATA_SIZE - 3, bit_array_byte_len(&decompressed));
+    ASSERT_MEM_EQ(DATA, decompressed.data, DATA_SIZE - 3);
+
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+
+    PASS();
+}
+
+TEST huffman_chunks() {
+    /// Skewed half so that the multi-symbol table is used as well
+    for (size_t i = 0; i < DATA_SIZE / 2; i++) {
+        DATA[i] = DATA[i] < 224 ? DATA[i] % 2 : DATA[i];
+    }
+
+    size_t chunk_sizes[] = {1, 1000, 256 * 1024, DATA_SIZE * 2};
+    size_t nof_streams[] = {1, 3};
+    HuffmanDecodeMode modes[] = {HuffmanDecodeMode_Single, HuffmanDecodeMode_Multi};
+    size_t len = DATA_SIZE - 5;
+
+    for (size_t c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); c++) {
+        for (size_t s = 0; s < sizeof(nof_streams) / sizeof(nof_streams[0]); s++) {
+            /// A single byte per chunk is only tried on a short input
+            size_t n = chunk_sizes[c] == 1 ? 5000 : len;
+            HuffmanOptions options = { .nof_streams = nof_streams[s], .chunk_size = chunk_sizes[c] };
+            BitArray compressed = huffman_compress_with_options(DATA, n, &options);
+            ASSERT_FALSE(got_error());
+
+            for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+                BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), modes[m]);
+                ASSERT_FALSE(got_error());
+
+                ASSERT_EQ(n, bit_array_byte_len(&decompressed));
+                ASSERT_MEM_EQ(DATA, decompressed.data, n);
+                bit_array_free(&decompressed);
+            }
+
+            /// A damaged offset index is detected instead of decoding garbage
+            if (chunk_sizes[c] == 1000 && nof_streams[s] == 1) {
+                size_t index = 3 + 1 + 4 + 8 + 600;
+                compressed.data[index] ^= 0x80;
+                BitArray broken = huffman_decompress(compressed.data, bit_array_byte_len(&compressed));
+                ASSERT(got_error());
+                clear_error();
+                bit_array_free(&broken);
+            }
+
+            bit_array_free(&compressed);
+        }
+    }
+
+    PASS();
+}
+
+TEST huffman_parallel_encode() {
+    /// Skewed so that the parts end in the middle of bytes and words
+    for (size_t i = 0; i < DATA_SIZE; i++) {
+        DATA[i] = DATA[i] < 128 ? DATA[i] % 5 : DATA[i];
+    }
+
+    HuffmanOptions serial = { .nof_streams = 1, .nof_threads = 1 };
+    BitArray expected = huffman_compress_with_options(DATA, DATA_SIZE, &serial);
+    ASSERT_FALSE(got_error());
+
+    size_t nof_threads[] = {2, 3, 7, 64};
+    for (size_t t = 0; t < sizeof(nof_threads) / sizeof(nof_threads[0]); t++) {
+        HuffmanOptions options = { .nof_streams = 1, .nof_threads = nof_threads[t] };
+        SegmentList input = segment_list_new();
+        SegmentList output = segment_list_new();
+
+        /// Segments of uneven length, the parts do not follow them
+        segment_list_push_bytes(&input, DATA, 3);
+        segment_list_push_bytes(&input, DATA + 3, 100000);
+        segment_list_push_bytes(&input, DATA + 100003, DATA_SIZE - 100003);
+
+        huffman_compress_segments(&input, &options, &output);
+        BitArray compressed = segment_list_join(&output);
+        ASSERT_FALSE(got_error());
+
+        ASSERT_EQ(bit_array_byte_len(&expected), bit_array_byte_len(&compressed));
+        ASSERT_MEM_EQ(expected.data, compressed.data, bit_array_byte_len(&expected));
+
+        bit_array_free(&compressed);
+        segment_list_free(&input);
+        segment_list_free(&output);
+    }
+
+    /// More threads than bytes
+    HuffmanOptions options = { .nof_streams = 1, .nof_threads = 5 };
+    BitArray small = huffman_compress_with_options(DATA, 3, &options);
+    BitArray decompressed = huffman_decompress(small.data, bit_array_byte_len(&small));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(3, bit_array_byte_len(&decompressed));
+    ASSERT_MEM_EQ(DATA, decompressed.data, 3);
+
+    bit_array_free(&small);
+    bit_array_free(&decompressed);
+    bit_array_free(&expected);
+
+    PASS();
+}
+
+TEST huffman_speculative() {
+    /// Random data first, then skewed so that the codes are short and many
+    for (int round = 0; round < 2; round++) {
+        for (size_t len = 100; len <= DATA_SIZE; len += DATA_SIZE - 100) {
+            BitArray compressed = huffman_compress(DATA, len);
+            BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), HuffmanDecodeMode_Speculative);
+            ASSERT_FALSE(got_error());
+
+            ASSERT_EQ(len, bit_array_byte_len(&decompressed));
+            ASSERT_MEM_EQ(DATA, decompressed.data, len);
+
+            bit_array_free(&compressed);
+            bit_array_free(&decompressed);
+        }
+
+        for (size_t i = 0; i < DATA_SIZE; i++) {
+            DATA[i] = DATA[i] < 160 ? DATA[i] % 3 : DATA[i];
+        }
+    }
+
+    /// Damaged stream still fails like the serial decoder
+    BitArray compressed = huffman_compress(DATA, DATA_SIZE);
+    compressed.len -= 64 * 8;
+    BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), HuffmanDecodeMode_Speculative);
+    ASSERT(got_error());
+    clear_error();
+
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+
+    PASS();
+}
+
+TEST huffman_compact_table() {
+    /// Full alphabet, a sparse one with runs of absent symbols, a single symbol and nothing at all
+    size_t lens[] = {DATA_SIZE, 3000, 50, 0};
+
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        if (l == 1) {
+            for (size_t i = 0; i < lens[l]; i++) DATA[i] = DATA[i] % 7 * 31;
+        } else if (l == 2) {
+            memset(DATA, 'x', lens[l]);
+        }
+
+        HuffmanOptions compact_options = { .nof_streams = 1 };
+        HuffmanOptions legacy_options = { .nof_streams = 1, .is_legacy_table = true };
+        BitArray compact = huffman_compress_with_options(DATA, lens[l], &compact_options);
+        BitArray legacy = huffman_compress_with_options(DATA, lens[l], &legacy_options);
+        ASSERT_FALSE(got_error());
+
+        BitArray compact_out = huffman_decompress(compact.data, bit_array_byte_len(&compact));
+        ASSERT_FALSE(got_error());
+        ASSERT_EQ(lens[l], bit_array_byte_len(&compact_out));
+        ASSERT_MEM_EQ(DATA, compact_out.data, lens[l]);
+
+        /// The legacy table cannot describe EOF alone, so empty input is always compact
+        if (lens[l]) {
+            BitArray legacy_out = huffman_decompress(legacy.data, bit_array_byte_len(&legacy));
+            ASSERT_FALSE(got_error());
+            ASSERT_EQ(lens[l], bit_array_byte_len(&legacy_out));
+            ASSERT_MEM_EQ(DATA, legacy_out.data, lens[l]);
+            ASSERT(bit_array_byte_len(&compact) <= bit_array_byte_len(&legacy));
+            bit_array_free(&legacy_out);
+        }
+
+        bit_array_free(&compact);
+        bit_array_free(&legacy);
+        bit_array_free(&compact_out);
+    }
+
+    PASS();
+}
+
+TEST huffman_explicit_length() {
+    /// Skewed half so that the multi-symbol table is used as well
+    for (size_t i = 0; i < DATA_SIZE / 2; i++) {
+        DATA[i] = DATA[i] < 192 ? DATA[i] % 4 : DATA[i];
+    }
+
+    HuffmanDecodeMode modes[] = {HuffmanDecodeMode_Single, HuffmanDecodeMode_Multi, HuffmanDecodeMode_Speculative};
+    size_t nof_streams[] = {1, 3};
+    size_t len = DATA_SIZE - 7;
+
+    for (size_t s = 0; s < sizeof(nof_streams) / sizeof(nof_streams[0]); s++) {
+        HuffmanOptions eof_options = { .nof_streams = nof_streams[s], .is_eof_symbol = true };
+        HuffmanOptions options = { .nof_streams = nof_streams[s] };
+        BitArray with_eof = huffman_compress_with_options(DATA, len, &eof_options);
+        BitArray compressed = huffman_compress_with_options(DATA, len, &options);
+        ASSERT_FALSE(got_error());
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            BitArray *inputs[] = {&with_eof, &compressed};
+
+            for (size_t i = 0; i < 2; i++) {
+                BitArray decompressed = huffman_decompress_with_mode(inputs[i]->data, bit_array_byte_len(inputs[i]), modes[m]);
+                ASSERT_FALSE(got_error());
+                ASSERT_EQ(len, bit_array_byte_len(&decompressed));
+                ASSERT_MEM_EQ(DATA, decompressed.data, len);
+                bit_array_free(&decompressed);
+            }
+        }
+
+        /// Both a missing and an extra byte at the end are detected
+        size_t byte_len = bit_array_byte_len(&compressed);
+        BitArray truncated = huffman_decompress(compressed.data, byte_len - 1);
+        ASSERT(got_error());
+        clear_error();
+
+        bit_array_push_n(&compressed, 0, 8);
+        BitArray extended = huffman_decompress_with_mode(compressed.data, byte_len + 1, HuffmanDecodeMode_Single);
+        ASSERT(got_error());
+        clear_error();
+
+        bit_array_free(&truncated);
+        bit_array_free(&extended);
+        bit_array_free(&with_eof);
+        bit_array_free(&compressed);
+    }
+
+    PASS();
+}
+
+TEST huffman_block_tables() {
+    /// Segments of very different statistics, next to ones that share theirs
+    size_t bounds[] = {0, 200000, 400000, 405000, 405010, 600000};
+    for (size_t i = 0; i < 200000; i++) DATA[i] %= 4;
+    memset(DATA + 400000, 'x', 5000);
+    for (size_t i = 405010; i < 600000; i++) DATA[i] %= 4;
+
+    SegmentList input = segment_list_new();
+    for (size_t i = 0; i + 1 < sizeof(bounds) / sizeof(bounds[0]); i++) {
+        segment_list_push_bytes(&input, DATA + bounds[i], bounds[i + 1] - bounds[i]);
+    }
+
+    HuffmanOptions shared_options = { .nof_streams = 1 };
+    HuffmanOptions options = { .nof_streams = 1, .has_block_tables = true };
+    SegmentList shared_output = segment_list_new();
+    SegmentList output = segment_list_new();
+    huffman_compress_segments(&input, &shared_options, &shared_output);
+    huffman_compress_segments(&input, &options, &output);
+    ASSERT_FALSE(got_error());
+
+    BitArray shared = segment_list_join(&shared_output);
+    BitArray compressed = segment_list_join(&output);
+    ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&shared));
+
+    HuffmanDecodeMode modes[] = {HuffmanDecodeMode_Auto, HuffmanDecodeMode_Single, HuffmanDecodeMode_Multi};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), modes[m]);
+        ASSERT_FALSE(got_error());
+        ASSERT_EQ(600000, bit_array_byte_len(&decompressed));
+        ASSERT_MEM_EQ(DATA, decompressed.data, 600000);
+        bit_array_free(&decompressed);
+    }
+
+    /// Block tables need the length of every run
+    HuffmanOptions invalid = { .nof_streams = 2, .has_block_tables = true };
+    SegmentList invalid_output = segment_list_new();
+    huffman_compress_segments(&input, &invalid, &invalid_output);
+    ASSERT(got_error());
+    clear_error();
+
+    segment_list_free(&input);
+    segment_list_free(&shared_output);
+    segment_list_free(&output);
+    segment_list_free(&invalid_output);
+    bit_array_free(&shared);
+    bit_array_free(&compressed);
+
+    PASS();
+}
+
+TEST huffman_table_map() {
+    /// Segments of three kinds of statistics, repeated and interleaved
+    size_t segment_len = 4000;
+    size_t nof_segments = 60;
+    for (size_t s = 0; s < nof_segments; s++) {
+        uint8_t *segment = DATA + s * segment_len;
+
+        for (size_t i = 0; i < segment_len; i++) {
+            segment[i] = s % 3 == 0 ? segment[i] % 4 : s % 3 == 1 ? 200 + segment[i] % 8 : segment[i];
+        }
+    }
+
+    SegmentList input = segment_list_new();
+    for (size_t s = 0; s < nof_segments; s++) {
+        segment_list_push_bytes(&input, DATA + s * segment_len, segment_len);
+    }
+
+    HuffmanOptions shared_options = { .nof_streams = 1 };
+    SegmentList shared_output = segment_list_new();
+    huffman_compress_segments(&input, &shared_options, &shared_output);
+    ASSERT_FALSE(got_error());
+
+    size_t nof_tables[] = {1, 3, 16, HUFFMAN_MAX_TABLES};
+    HuffmanDecodeMode modes[] = {HuffmanDecodeMode_Single, HuffmanDecodeMode_Multi};
+
+    for (size_t t = 0; t < sizeof(nof_tables) / sizeof(nof_tables[0]); t++) {
+        HuffmanOptions options = { .nof_streams = 1, .has_block_tables = true, .nof_tables = nof_tables[t] };
+        SegmentList output = segment_list_new();
+        huffman_compress_segments(&input, &options, &output);
+        ASSERT_FALSE(got_error());
+
+        BitArray compressed = segment_list_join(&output);
+
+        /// A single table is the shared one, more of them separate the kinds
+        if (nof_tables[t] > 1) {
+            ASSERT(bit_array_byte_len(&compressed) < segment_list_byte_len(&shared_output));
+        }
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), modes[m]);
+            ASSERT_FALSE(got_error());
+            ASSERT_EQ(segment_len * nof_segments, bit_array_byte_len(&decompressed));
+            ASSERT_MEM_EQ(DATA, decompressed.data, segment_len * nof_segments);
+            bit_array_free(&decompressed);
+        }
+
+        bit_array_free(&compressed);
+        segment_list_free(&output);
+    }
+
+    HuffmanOptions invalid = { .nof_streams = 1, .has_block_tables = true, .nof_tables = HUFFMAN_MAX_TABLES + 1 };
+    SegmentList invalid_output = segment_list_new();
+    huffman_compress_segments(&input, &invalid, &invalid_output);
+    ASSERT(got_error());
+    clear_error();
+
+    segment_list_free(&input);
+    segment_list_free(&shared_output);
+    segment_list_free(&invalid_output);
+
+    PASS();
+}
+
+TEST huffman_contexts() {
+    /// Small residuals are mostly followed by small ones, large ones by anything
+    size_t len = 500000;
+    for (size_t i = 1; i < len; i++) {
+        uint8_t previous = DATA[i - 1];
+        bool is_small = previous < 2 || previous > 254;
+        DATA[i] = is_small && DATA[i] < 240 ? DATA[i] % 3 : DATA[i];
+    }
+
+    HuffmanOptions shared_options = { .nof_streams = 1 };
+    BitArray shared = huffman_compress_with_options(DATA, len, &shared_options);
+    ASSERT_FALSE(got_error());
+
+    HuffmanOptions options = { .nof_streams = 1, .nof_contexts = HUFFMAN_MAX_CONTEXTS };
+    BitArray compressed = huffman_compress_with_options(DATA, len, &options);
+    ASSERT_FALSE(got_error());
+    ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&shared));
+
+    HuffmanDecodeMode modes[] = {HuffmanDecodeMode_Auto, HuffmanDecodeMode_Single, HuffmanDecodeMode_Multi};
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), modes[m]);
+        ASSERT_FALSE(got_error());
+        ASSERT_EQ(len, bit_array_byte_len(&decompressed));
+        ASSERT_MEM_EQ(DATA, decompressed.data, len);
+        bit_array_free(&decompressed);
+    }
+
+    /// Without any dependency on the previous byte, a single table is kept
+    HuffmanOptions random_options = { .nof_streams = 1, .nof_contexts = HUFFMAN_MAX_CONTEXTS };
+    BitArray random = huffman_compress_with_options(DATA + len, 1000, &random_options);
+    BitArray random_shared = huffman_compress_with_options(DATA + len, 1000, &shared_options);
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(bit_array_byte_len(&random_shared), bit_array_byte_len(&random));
+
+    HuffmanOptions invalid[] = {
+        { .nof_streams = 1, .nof_contexts = HUFFMAN_MAX_CONTEXTS + 1 },
+        { .nof_streams = 2, .nof_contexts = HUFFMAN_MAX_CONTEXTS },
+        { .nof_streams = 1, .nof_contexts = HUFFMAN_MAX_CONTEXTS, .has_block_tables = true },
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        BitArray result = huffman_compress_with_options(DATA, len, &invalid[i]);
+        ASSERT(got_error());
+        clear_error();
+        bit_array_free(&result);
+    }
+
+    bit_array_free(&shared);
+    bit_array_free(&compressed);
+    bit_array_free(&random);
+    bit_array_free(&random_shared);
+
+    PASS();
+}
+
+TEST huffman_pairs() {
+    /// Mostly zeros, far below one bit per byte. The rare values make more pairs than the dictionary holds.
+    size_t lens[] = {0, 1, 2, 3, 100001, 500000};
+    for (size_t i = 0; i < 500000; i++) {
+        DATA[i] = DATA[i] < 240 ? 0 : DATA[i];
+    }
+
+    HuffmanDecodeMode modes[] = {HuffmanDecodeMode_Auto, HuffmanDecodeMode_Single, HuffmanDecodeMode_Multi};
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        HuffmanOptions byte_options = { .nof_streams = 1 };
+        BitArray bytes = huffman_compress_with_options(DATA, lens[l], &byte_options);
+        ASSERT_FALSE(got_error());
+
+        HuffmanOptions options = { .nof_streams = 1, .has_pairs = true };
+        BitArray compressed = huffman_compress_with_options(DATA, lens[l], &options);
+        ASSERT_FALSE(got_error());
+        ASSERT(bit_array_byte_len(&compressed) <= bit_array_byte_len(&bytes));
+
+        if (lens[l] > 1000) {
+            ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&bytes) * 3 / 4);
+        }
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            BitArray decompressed = huffman_decompress_with_mode(compressed.data, bit_array_byte_len(&compressed), modes[m]);
+            ASSERT_FALSE(got_error());
+            ASSERT_EQ(lens[l], bit_array_byte_len(&decompressed));
+            ASSERT_MEM_EQ(DATA, decompressed.data, lens[l]);
+            bit_array_free(&decompressed);
+        }
+
+        bit_array_free(&bytes);
+        bit_array_free(&compressed);
+    }
+
+    /// Against block tables, the smaller layout is kept
+    SegmentList input = segment_list_new();
+    segment_list_push_bytes(&input, DATA, 250000);
+    segment_list_push_bytes(&input, DATA + 250000, 250001);
+
+    HuffmanOptions table_options = { .nof_streams = 1, .has_block_tables = true };
+    HuffmanOptions pair_options = { .nof_streams = 1, .has_block_tables = true, .has_pairs = true };
+    SegmentList table_output = segment_list_new();
+    SegmentList pair_output = segment_list_new();
+    huffman_compress_segments(&input, &table_options, &table_output);
+    huffman_compress_segments(&input, &pair_options, &pair_output);
+    ASSERT_FALSE(got_error());
+    ASSERT(segment_list_byte_len(&pair_output) < segment_list_byte_len(&table_output));
+
+    BitArray compressed = segment_list_join(&pair_output);
+    BitArray decompressed = huffman_decompress(compressed.data, bit_array_byte_len(&compressed));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(500001, bit_array_byte_len(&decompressed));
+    ASSERT_MEM_EQ(DATA, decompressed.data, 500001);
+
+    HuffmanOptions invalid = { .nof_streams = 2, .has_pairs = true };
+    BitArray result = huffman_compress_with_options(DATA, 1000, &invalid);
+    ASSERT(got_error());
+    clear_error();
+
+    bit_array_free(&result);
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+    segment_list_free(&input);
+    segment_list_free(&table_output);
+    segment_list_free(&pair_output);
+
+    PASS();
+}
+
+TEST huffman_code_len_limit() {
+    /// Fibonacci frequencies would produce codes of about 25 bits without the limit
+    size_t len = 0;
+    uint64_t a = 1, b = 1;
+    for (int symbol = 0; symbol < 26; symbol++) {
+        for (uint64_t i = 0; i < a && len < DATA_SIZE; i++) {
+            DATA[len++] = symbol;
+        }
+
+        uint64_t tmp = a + b;
+        a = b;
+        b = tmp;
+    }
+
+    size_t limits[] = {0, 9, 12, 24, 32};
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+        HuffmanOptions options = { .nof_streams = 1, .max_code_len = limits[i] };
+        BitArray compressed = huffman_compress_with_options(DATA, len, &options);
+        ASSERT_FALSE(got_error());
+        BitArray decompressed = huffman_decompress(compressed.data, bit_array_byte_len(&compressed));
+        ASSERT_FALSE(got_error());
+
+        ASSERT_EQ(len, bit_array_byte_len(&decompressed));
+        ASSERT_MEM_EQ(DATA, decompressed.data, len);
+
+        bit_array_free(&compressed);
+        bit_array_free(&decompressed);
+    }
+
+    /// 26 symbols cannot fit into 4 bits
+    HuffmanOptions options = { .nof_streams = 1, .max_code_len = 4 };
+    BitArray compressed = huffman_compress_with_options(DATA, len, &options);
+    ASSERT(got_error());
+    bit_array_free(&compressed);
+
+    PASS();
+}
+
 GREATEST_SUITE(huffman) {
     GREATEST_SET_SETUP_CB(huffman_setup, NULL);
     GREATEST_SET_TEARDOWN_CB(huffman_teardown, NULL);
 
     RUN_TEST(huffman_correctness);
+    RUN_TEST(huffman_decode_modes);
+    RUN_TEST(huffman_streams);
+    RUN_TEST(huffman_chunks);
+    RUN_TEST(huffman_parallel_encode);
+    RUN_TEST(huffman_speculative);
+    RUN_TEST(huffman_compact_table);
+    RUN_TEST(huffman_explicit_length);
+    RUN_TEST(huffman_block_tables);
+    RUN_TEST(huffman_table_map);
+    RUN_TEST(huffman_contexts);
+    RUN_TEST(huffman_pairs);
+    RUN_TEST(huffman_code_len_limit);
 }
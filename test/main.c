@@ -15,6 +15,11 @@ void fill_random(uint8_t *output, int length) {
 #include "rle.c"
 #include "image.c"
 #include "compressor.c"
+#include "segments.c"
+#include "histogram.c"
+#include "thread_pool.c"
+#include "ans.c"
+#include "range.c"
 
 GREATEST_MAIN_DEFS();
 
@@ -27,6 +32,11 @@ int main(int argc, char **argv) {
     RUN_SUITE(rle);
     RUN_SUITE(image);
     RUN_SUITE(compressor);
+    RUN_SUITE(segments);
+    RUN_SUITE(histogram);
+    RUN_SUITE(thread_pool);
+    RUN_SUITE(ans);
+    RUN_SUITE(range);
 
     GREATEST_MAIN_END();
 }
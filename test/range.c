@@ -0,0 +1,178 @@
+#include "greatest.h"
+#include "../src/error.h"
+#include "../src/range.h"
+#include "../src/ans.h"
+#include "../src/huffman.h"
+
+SUITE(range);
+
+#define RANGE_DATA_SIZE (1024 * 1024)
+uint8_t *RANGE_DATA;
+
+static void range_setup(void *arg) {
+    clear_error();
+    RANGE_DATA = malloc(RANGE_DATA_SIZE);
+    fill_random(RANGE_DATA, RANGE_DATA_SIZE);
+    (void)arg;
+}
+
+static void range_teardown(void *arg) {
+    clear_error();
+    free(RANGE_DATA);
+    (void)arg;
+}
+
+TEST range_correctness() {
+    size_t lens[] = {0, 1, 2, 3, 1000, RANGE_DATA_SIZE};
+
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        BitArray compressed = range_compress(RANGE_DATA, lens[l]);
+        ASSERT_FALSE(got_error());
+        ASSERT(range_has_magic(compressed.data, bit_array_byte_len(&compressed)));
+
+        BitArray decompressed = range_decompress(compressed.data, bit_array_byte_len(&compressed));
+        ASSERT_FALSE(got_error());
+        ASSERT_EQ(lens[l], bit_array_byte_len(&decompressed));
+        ASSERT_MEM_EQ(RANGE_DATA, decompressed.data, lens[l]);
+
+        bit_array_free(&compressed);
+        bit_array_free(&decompressed);
+    }
+
+    PASS();
+}
+
+TEST range_skewed() {
+    /// Far below one bit per byte, where Huffman codes cannot follow
+    for (size_t i = 0; i < RANGE_DATA_SIZE; i++) {
+        RANGE_DATA[i] = RANGE_DATA[i] < 250 ? 0 : RANGE_DATA[i] % 3 + 1;
+    }
+
+    BitArray huffman = huffman_compress(RANGE_DATA, RANGE_DATA_SIZE);
+    BitArray compressed = range_compress(RANGE_DATA, RANGE_DATA_SIZE);
+    ASSERT_FALSE(got_error());
+    ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&huffman) / 2);
+
+    BitArray decompressed = range_decompress(compressed.data, bit_array_byte_len(&compressed));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(RANGE_DATA_SIZE, bit_array_byte_len(&decompressed));
+    ASSERT_MEM_EQ(RANGE_DATA, decompressed.data, RANGE_DATA_SIZE);
+
+    /// A single symbol is learnt within a few bytes, then costs about a tenth of a bit
+    memset(RANGE_DATA, 7, RANGE_DATA_SIZE);
+    BitArray single = range_compress(RANGE_DATA, RANGE_DATA_SIZE);
+    ASSERT_FALSE(got_error());
+    ASSERT(bit_array_byte_len(&single) < RANGE_DATA_SIZE / 64);
+
+    BitArray single_decompressed = range_decompress(single.data, bit_array_byte_len(&single));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(RANGE_DATA_SIZE, bit_array_byte_len(&single_decompressed));
+    ASSERT_MEM_EQ(RANGE_DATA, single_decompressed.data, RANGE_DATA_SIZE);
+
+    bit_array_free(&huffman);
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+    bit_array_free(&single);
+    bit_array_free(&single_decompressed);
+
+    PASS();
+}
+
+TEST range_context() {
+    /// Every byte follows from the previous one, which a table of the byte frequencies cannot see
+    for (size_t i = 1; i < RANGE_DATA_SIZE; i++) {
+        RANGE_DATA[i] = RANGE_DATA[i] < 16 ? RANGE_DATA[i] : RANGE_DATA[i - 1] * 5 + 1;
+    }
+
+    BitArray ans = ans_compress(RANGE_DATA, RANGE_DATA_SIZE);
+    BitArray compressed = range_compress(RANGE_DATA, RANGE_DATA_SIZE);
+    ASSERT_FALSE(got_error());
+    ASSERT(bit_array_byte_len(&compressed) < bit_array_byte_len(&ans) / 4);
+
+    BitArray decompressed = range_decompress(compressed.data, bit_array_byte_len(&compressed));
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(RANGE_DATA_SIZE, bit_array_byte_len(&decompressed));
+    ASSERT_MEM_EQ(RANGE_DATA, decompressed.data, RANGE_DATA_SIZE);
+
+    bit_array_free(&ans);
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+
+    PASS();
+}
+
+TEST range_format_flags() {
+    SegmentList input = segment_list_new();
+    SegmentList output = segment_list_new();
+    segment_list_push_bytes(&input, RANGE_DATA, 10000);
+
+    range_compress_segments(&input, RANGE_FLAG_LONG_RUNS, &output);
+    BitArray compressed = segment_list_join(&output);
+    ASSERT_FALSE(got_error());
+    size_t len = bit_array_byte_len(&compressed);
+    ASSERT_EQ(RANGE_FLAG_LONG_RUNS, range_flags(compressed.data, len));
+
+    /// The flags are kept for the caller, the data decodes the same
+    BitArray decompressed = range_decompress(compressed.data, len);
+    ASSERT_FALSE(got_error());
+    ASSERT_MEM_EQ(RANGE_DATA, decompressed.data, 10000);
+
+    /// Unknown flags are rejected
+    compressed.data[3] |= 0x80;
+    BitArray unknown = range_decompress(compressed.data, len);
+    ASSERT(got_error());
+    clear_error();
+
+    segment_list_free(&input);
+    segment_list_free(&output);
+    bit_array_free(&compressed);
+    bit_array_free(&decompressed);
+    bit_array_free(&unknown);
+
+    PASS();
+}
+
+TEST range_invalid() {
+    BitArray compressed = range_compress(RANGE_DATA, 10000);
+    ASSERT_FALSE(got_error());
+    size_t len = bit_array_byte_len(&compressed);
+
+    /// Truncated data runs out before its length
+    BitArray truncated = range_decompress(compressed.data, len - 100);
+    ASSERT(got_error());
+    clear_error();
+
+    /// Data past the flushed bytes is not part of the stream
+    uint8_t *padded = calloc(len + 1, 1);
+    memcpy(padded, compressed.data, len);
+    BitArray corrupted = range_decompress(padded, len + 1);
+    ASSERT(got_error());
+    clear_error();
+    free(padded);
+
+    /// A Huffman stream is not taken for a range coded one
+    BitArray huffman = huffman_compress(RANGE_DATA, 10000);
+    ASSERT_FALSE(range_has_magic(huffman.data, bit_array_byte_len(&huffman)));
+    BitArray wrong = range_decompress(huffman.data, bit_array_byte_len(&huffman));
+    ASSERT(got_error());
+    clear_error();
+
+    bit_array_free(&compressed);
+    bit_array_free(&truncated);
+    bit_array_free(&corrupted);
+    bit_array_free(&huffman);
+    bit_array_free(&wrong);
+
+    PASS();
+}
+
+GREATEST_SUITE(range) {
+    GREATEST_SET_SETUP_CB(range_setup, NULL);
+    GREATEST_SET_TEARDOWN_CB(range_teardown, NULL);
+
+    RUN_TEST(range_correctness);
+    RUN_TEST(range_skewed);
+    RUN_TEST(range_context);
+    RUN_TEST(range_format_flags);
+    RUN_TEST(range_invalid);
+}
@@ -36,10 +36,211 @@ TEST rle_correctness() {
     PASS();
 }
 
+TEST rle_kernels() {
+    RleKernel kernels[] = {RleKernel_Auto, RleKernel_Scalar, RleKernel_Sse2, RleKernel_Avx2};
+
+    /// Runs of every length up to past the longest token, ending anywhere within a vector
+    size_t i = 0;
+    for (size_t run = 1; i < RLE_DATA_SIZE; run = run % (3 * RLE_MAX_RUN) + 1) {
+        for (size_t k = 0; k < run && i < RLE_DATA_SIZE; k++) {
+            RLE_DATA[i++] = run;
+        }
+    }
+
+    size_t lengths[] = {1, 2, 15, 16, 17, 33, RLE_MAX_RUN + 1, 100007, RLE_DATA_SIZE};
+    uint8_t *tmp = malloc(RLE_DATA_SIZE);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        for (RleFormat format = RleFormat_Short; format <= RleFormat_Long; format++) {
+            BitArray expected = rle_encode_with(RLE_DATA, lengths[l], format, RleKernel_Scalar);
+
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+                BitArray compressed = rle_encode_with(RLE_DATA, lengths[l], format, kernels[k]);
+                ASSERT_EQ(expected.len, compressed.len);
+                ASSERT_MEM_EQ(expected.data, compressed.data, bit_array_byte_len(&expected));
+                bit_array_free(&compressed);
+            }
+
+            size_t len = rle_decode_with(expected.data, bit_array_byte_len(&expected), tmp, lengths[l], format);
+            ASSERT_FALSE(got_error());
+            ASSERT_EQ(bit_array_byte_len(&expected), len);
+            ASSERT_MEM_EQ(RLE_DATA, tmp, lengths[l]);
+
+            bit_array_free(&expected);
+        }
+    }
+
+    free(tmp);
+
+    PASS();
+}
+
+TEST rle_tokens() {
+    /// Runs of 3, 2 and 4 bytes between literals and a final run, which the short format stores one repeat longer
+    uint8_t mixed[] = {7, 7, 7, 1, 2, 2, 3, 3, 3, 3, 9, 5, 5};
+    uint8_t mixed_short[] = {0x2D, 1, 7, 1, 0, 2, 2, 3, 9, 1, 5};
+    uint8_t mixed_long[] = {0x2D, 1, 7, 1, 0, 2, 2, 3, 9, 0, 5};
+
+    /// Two maximal runs, the long format extends them by a varint of no more repeats
+    for (size_t i = 0; i < 2 * RLE_MAX_RUN; i++) {
+        RLE_DATA[i] = i / RLE_MAX_RUN;
+    }
+    uint8_t runs_short[] = {0x03, 0xFF, 0, 0xFF, 1};
+    uint8_t runs_long[] = {0x03, 0xFF, 0, 0, 0xFF, 0, 1};
+
+    struct { uint8_t *input; size_t len; RleFormat format; uint8_t *expected; size_t expected_len; } cases[] = {
+        {mixed, sizeof(mixed), RleFormat_Short, mixed_short, sizeof(mixed_short)},
+        {mixed, sizeof(mixed), RleFormat_Long, mixed_long, sizeof(mixed_long)},
+        {RLE_DATA, 2 * RLE_MAX_RUN, RleFormat_Short, runs_short, sizeof(runs_short)},
+        {RLE_DATA, 2 * RLE_MAX_RUN, RleFormat_Long, runs_long, sizeof(runs_long)},
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        uint8_t output[16];
+        size_t len = rle_encode_into(cases[c].input, cases[c].len, output, cases[c].format, RleKernel_Auto);
+
+        ASSERT_EQ(cases[c].expected_len, len);
+        ASSERT_MEM_EQ(cases[c].expected, output, len);
+    }
+
+    PASS();
+}
+
+TEST rle_bound() {
+    /// Literals only reach the bound, every 8 of them add a flag byte, pairs and maximal runs stay below it
+    size_t lengths[] = {1, 7, 8, 9, 1001, RLE_DATA_SIZE};
+    uint8_t *tmp = malloc(RLE_DATA_SIZE);
+
+    for (size_t pattern = 0; pattern < 3; pattern++) {
+        for (size_t i = 0; i < RLE_DATA_SIZE; i++) {
+            RLE_DATA[i] = pattern == 0 ? i : pattern == 1 ? i / 2 % 2 : i / RLE_MAX_RUN % 2;
+        }
+
+        for (RleFormat format = RleFormat_Short; format <= RleFormat_Long; format++) {
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                size_t bound = rle_max_encoded_len(lengths[l]);
+                ASSERT_EQ(lengths[l] + (lengths[l] + 7) / 8, bound);
+
+                uint8_t *output = malloc(bound + 1);
+                output[bound] = 0xA5;
+
+                size_t len = rle_encode_into(RLE_DATA, lengths[l], output, format, RleKernel_Auto);
+                ASSERT(len <= bound);
+                ASSERT_EQ(0xA5, output[bound]);
+
+                if (pattern == 0) {
+                    ASSERT_EQ(bound, len);
+
+                    for (size_t i = 0; i < lengths[l]; i++) {
+                        ASSERT_EQ(0, output[i / 8 * 9]);
+                        ASSERT_EQ(RLE_DATA[i], output[i / 8 * 9 + 1 + i % 8]);
+                    }
+                }
+
+                ASSERT_EQ(len, rle_decode_with(output, len, tmp, lengths[l], format));
+                ASSERT_MEM_EQ(RLE_DATA, tmp, lengths[l]);
+
+                free(output);
+            }
+        }
+    }
+
+    free(tmp);
+    PASS();
+}
+
+TEST rle_decode_bounds() {
+    /// Flat areas, short runs and literals, so that groups take both decoding paths
+    for (size_t i = 0; i < RLE_DATA_SIZE; i++) {
+        RLE_DATA[i] = (i / 4096) % 2 ? 0 : RLE_DATA[i] % 4 ? RLE_DATA[i] : RLE_DATA[i - i % 3];
+    }
+
+    BitArray compressed = rle_encode(RLE_DATA, RLE_DATA_SIZE);
+    size_t compressed_len = bit_array_byte_len(&compressed);
+    uint8_t *tmp = malloc(RLE_DATA_SIZE + 1);
+
+    /// The output stops at its length, without writing past it
+    size_t lengths[] = {1, 257, 2056, 5000, 100007, RLE_DATA_SIZE - 1};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        tmp[lengths[l]] = 0xA5;
+        size_t len = rle_decode(compressed.data, compressed_len, tmp, lengths[l]);
+
+        ASSERT_FALSE(got_error());
+        ASSERT(len <= compressed_len);
+        ASSERT_MEM_EQ(RLE_DATA, tmp, lengths[l]);
+        ASSERT_EQ(0xA5, tmp[lengths[l]]);
+    }
+
+    /// A count without its byte
+    uint8_t truncated[] = {0x01, 0x05};
+    rle_decode(truncated, sizeof(truncated), tmp, RLE_DATA_SIZE);
+    ASSERT(got_error());
+    clear_error();
+
+    bit_array_free(&compressed);
+    free(tmp);
+
+    PASS();
+}
+
+TEST rle_long_runs() {
+    /// Runs around the lengths where the varint of the repeats past 257 grows
+    size_t runs[] = {2, 256, 257, 258, 257 + 127, 257 + 128, 257 + 16383, 257 + 16384, 1000000};
+    size_t len = 0;
+
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        memset(RLE_DATA + len, r, runs[r]);
+        len += runs[r];
+    }
+
+    /// Every run is a single token of a count and a byte, the 7 runs from 257 on add 13 varint bytes
+    BitArray compressed = rle_encode_with(RLE_DATA, len, RleFormat_Long, RleKernel_Auto);
+    size_t compressed_len = bit_array_byte_len(&compressed);
+    ASSERT_EQ(2 + 9 * 2 + 13, compressed_len);
+
+    BitArray short_compressed = rle_encode_with(RLE_DATA, len, RleFormat_Short, RleKernel_Auto);
+    ASSERT(bit_array_byte_len(&short_compressed) > len / RLE_MAX_RUN * 2);
+
+    uint8_t *tmp = malloc(len);
+    size_t decoded_len = rle_decode_with(compressed.data, compressed_len, tmp, len, RleFormat_Long);
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(compressed_len, decoded_len);
+    ASSERT_MEM_EQ(RLE_DATA, tmp, len);
+
+    /// A shorter output cuts the run in the middle
+    memset(tmp, 0, len);
+    rle_decode_with(compressed.data, compressed_len, tmp, 1000, RleFormat_Long);
+    ASSERT_FALSE(got_error());
+    ASSERT_MEM_EQ(RLE_DATA, tmp, 1000);
+    ASSERT_EQ(0, tmp[1000]);
+
+    /// A varint without its end, and one longer than 64 bits
+    uint8_t truncated[] = {0x01, 0xFF, 0x80, 0x80};
+    rle_decode_with(truncated, sizeof(truncated), tmp, len, RleFormat_Long);
+    ASSERT(got_error());
+    clear_error();
+
+    uint8_t overlong[] = {0x01, 0xFF, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0x00};
+    rle_decode_with(overlong, sizeof(overlong), tmp, len, RleFormat_Long);
+    ASSERT(got_error());
+    clear_error();
+
+    bit_array_free(&compressed);
+    bit_array_free(&short_compressed);
+    free(tmp);
+
+    PASS();
+}
+
 GREATEST_SUITE(rle) {
     GREATEST_SET_SETUP_CB(rle_setup, NULL);
     GREATEST_SET_TEARDOWN_CB(rle_teardown, NULL);
 
     RUN_TEST(rle_correctness);
+    RUN_TEST(rle_kernels);
+    RUN_TEST(rle_tokens);
+    RUN_TEST(rle_bound);
+    RUN_TEST(rle_decode_bounds);
+    RUN_TEST(rle_long_runs);
 }
 
@@ -0,0 +1,103 @@
+#include "greatest.h"
+#include "../src/error.h"
+#include "../src/segments.h"
+#include "../src/huffman.h"
+
+SUITE(segments);
+
+static void segments_setup(void *arg) {
+    clear_error();
+    (void)arg;
+}
+
+TEST segments_join() {
+    uint8_t bytes[] = "hello, world";
+    SegmentList list = segment_list_new();
+    BitArray arr = bit_array_new(NULL, 0);
+    bit_array_push_n(&arr, 0xABC, 12);
+
+    segment_list_push_bytes(&list, bytes, 5);
+    segment_list_push(&list, &arr);
+    segment_list_push_bytes(&list, bytes + 5, 0);
+    segment_list_push_bytes(&list, bytes + 5, 7);
+
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(3, list.size);
+    ASSERT_EQ(14, segment_list_byte_len(&list));
+    ASSERT_EQ(NULL, arr.data);
+
+    BitArray joined = segment_list_join(&list);
+    uint8_t expected[] = {'h', 'e', 'l', 'l', 'o', 0xBC, 0x0A, ',', ' ', 'w', 'o', 'r', 'l', 'd'};
+
+    ASSERT_EQ(14 * 8, joined.len);
+    ASSERT_MEM_EQ(expected, joined.data, sizeof(expected));
+
+    bit_array_free(&joined);
+    segment_list_free(&list);
+    PASS();
+}
+
+TEST segments_write() {
+    SegmentList list = segment_list_new();
+    SegmentList tail = segment_list_new();
+    uint8_t data[2000];
+    fill_random(data, sizeof(data));
+
+    /// More segments than a single `writev` call accepts
+    for (size_t i = 0; i < sizeof(data); i++) {
+        segment_list_push_bytes(i < 1000 ? &list : &tail, data + i, 1);
+    }
+
+    segment_list_append(&list, &tail);
+    ASSERT_EQ(0, tail.size);
+    ASSERT_EQ(sizeof(data), list.size);
+
+    FILE *file = tmpfile();
+    segment_list_write(&list, fileno(file));
+    ASSERT_FALSE(got_error());
+
+    uint8_t result[sizeof(data)];
+    rewind(file);
+    ASSERT_EQ(sizeof(data), fread(result, 1, sizeof(result), file));
+    ASSERT_MEM_EQ(data, result, sizeof(data));
+
+    fclose(file);
+    segment_list_free(&tail);
+    segment_list_free(&list);
+    PASS();
+}
+
+TEST segments_huffman() {
+    uint8_t data[4096];
+    fill_random(data, sizeof(data));
+
+    HuffmanOptions options = { .nof_streams = 3 };
+    BitArray expected = huffman_compress_with_options(data, sizeof(data), &options);
+
+    SegmentList input = segment_list_new();
+    SegmentList output = segment_list_new();
+    segment_list_push_bytes(&input, data, 1000);
+    segment_list_push_bytes(&input, data + 1000, 1);
+    segment_list_push_bytes(&input, data + 1001, sizeof(data) - 1001);
+
+    huffman_compress_segments(&input, &options, &output);
+    BitArray joined = segment_list_join(&output);
+
+    ASSERT_FALSE(got_error());
+    ASSERT_EQ(bit_array_byte_len(&expected), bit_array_byte_len(&joined));
+    ASSERT_MEM_EQ(expected.data, joined.data, bit_array_byte_len(&joined));
+
+    bit_array_free(&expected);
+    bit_array_free(&joined);
+    segment_list_free(&input);
+    segment_list_free(&output);
+    PASS();
+}
+
+GREATEST_SUITE(segments) {
+    GREATEST_SET_SETUP_CB(segments_setup, NULL);
+
+    RUN_TEST(segments_join);
+    RUN_TEST(segments_write);
+    RUN_TEST(segments_huffman);
+}
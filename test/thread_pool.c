@@ -0,0 +1,63 @@
+#include "greatest.h"
+#include "../src/error.h"
+#include "../src/thread_pool.h"
+#include <stdatomic.h>
+
+SUITE(thread_pool);
+
+#define POOL_NOF_JOBS 1000
+
+static void thread_pool_setup(void *arg) {
+    clear_error();
+    (void)arg;
+}
+
+static void thread_pool_count_job(void *context, size_t index) {
+    atomic_int *counts = context;
+    atomic_fetch_add(&counts[index], 1);
+}
+
+static void thread_pool_failing_job(void *context, size_t index) {
+    (void)context;
+
+    if (index == 10) {
+        set_error(Error_InvalidFormat);
+    }
+}
+
+TEST thread_pool_every_job() {
+    static atomic_int counts[POOL_NOF_JOBS];
+
+    for (size_t nof_threads = 0; nof_threads <= 4; nof_threads++) {
+        for (size_t i = 0; i < POOL_NOF_JOBS; i++) {
+            atomic_init(&counts[i], 0);
+        }
+
+        thread_pool_run(thread_pool_count_job, counts, POOL_NOF_JOBS, nof_threads);
+        ASSERT_FALSE(got_error());
+
+        for (size_t i = 0; i < POOL_NOF_JOBS; i++) {
+            ASSERT_EQ(1, atomic_load(&counts[i]));
+        }
+    }
+
+    PASS();
+}
+
+TEST thread_pool_error() {
+    thread_pool_run(thread_pool_failing_job, NULL, POOL_NOF_JOBS, 4);
+    ASSERT_EQ(Error_InvalidFormat, got_error());
+    clear_error();
+
+    thread_pool_run(thread_pool_count_job, NULL, 0, 4);
+    ASSERT_FALSE(got_error());
+
+    PASS();
+}
+
+GREATEST_SUITE(thread_pool) {
+    GREATEST_SET_SETUP_CB(thread_pool_setup, NULL);
+
+    RUN_TEST(thread_pool_every_job);
+    RUN_TEST(thread_pool_error);
+}